@@ -0,0 +1,379 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Lock-free atomic shared_ptr and weak_ptr in C++11.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cassert>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/*
+Notes:
+1.  std::atomic_load etc. of a std::shared_ptr are not lock-free with
+    libstdc++ and libc++. They take one of a pool of global mutexes, chosen
+    by hashing the address of the shared_ptr. So unrelated atomic
+    shared_ptrs contend on the same mutex.
+2.  atomic_ptr is lock-free wherever a 64 bit std::atomic is, eg x86-64
+    and AArch64. It uses split (differential) reference counting. The value
+    is held by a heap allocated holder. The 64 bit atomic word packs the
+    address of the current holder in its low 48 bits with a count of the
+    loads in progress on it in its high 16 bits. A load increments that
+    count together with reading the address, in one fetch_add, so the
+    holder cannot be deleted under it. When the holder is replaced, the
+    replacer transfers the count of loads still in progress to the holder
+    itself, and the last of those loads deletes it.
+3.  Requires user space addresses of at most 48 bits, and at most 65535
+    loads in progress at once on one atomic_ptr. Pointer tagging, eg
+    AArch64 MTE, is not supported.
+4.  Ptr is std::shared_ptr<T> or std::weak_ptr<T>. See atomic_shared_ptr and
+    atomic_weak_ptr.
+*/
+
+namespace lockfree
+{
+
+template <typename Ptr>
+class atomic_ptr
+{
+public:
+    using value_type = Ptr;
+
+    constexpr atomic_ptr () noexcept : word_ {0}
+    {
+    }
+
+    explicit atomic_ptr (Ptr desired) : word_ {pack (make_holder (desired))}
+    {
+    }
+
+    atomic_ptr (const atomic_ptr &) = delete;
+    atomic_ptr & operator = (const atomic_ptr &) = delete;
+
+    ~atomic_ptr ()
+    {
+        auto word = word_.load (std::memory_order_relaxed);
+        adjust (holder_of (word), count_of (word));
+    }
+
+    bool is_lock_free () const noexcept
+    {
+        return word_.is_lock_free ();
+    }
+
+    Ptr load () const
+    {
+        auto h = acquire ();
+
+        Ptr value;
+        if (h)
+        {
+            value = h->value;
+        }
+
+        release (h);
+
+        return value;
+    }
+
+    operator Ptr () const
+    {
+        return load ();
+    }
+
+    void store (Ptr desired)
+    {
+        auto word = word_.exchange (
+            pack (make_holder (desired)), std::memory_order_acq_rel
+        );
+
+        adjust (holder_of (word), count_of (word));
+    }
+
+    atomic_ptr & operator = (Ptr desired)
+    {
+        store (std::move (desired));
+        return * this;
+    }
+
+    Ptr exchange (Ptr desired)
+    {
+        auto word = word_.exchange (
+            pack (make_holder (desired)), std::memory_order_acq_rel
+        );
+
+        // the replaced holder lives at least until its count is transferred.
+        Ptr value;
+        auto replaced = holder_of (word);
+        if (replaced)
+        {
+            value = replaced->value;
+        }
+
+        adjust (replaced, count_of (word));
+
+        return value;
+    }
+
+    //
+    // Like std::atomic_compare_exchange_weak for std::shared_ptr, values are
+    // equivalent if they share ownership and, for shared_ptr, also hold the
+    // same pointer.
+    // Fails only if the value is not equivalent to expected, in which case
+    // the value is loaded into expected.
+    //
+    bool compare_exchange_weak (Ptr & expected, Ptr desired)
+    {
+        auto h = acquire ();
+        if (! equivalent (h, expected))
+        {
+            expected = h ? h->value : Ptr {};
+            release (h);
+            return false;
+        }
+
+        auto desired_holder = make_holder (desired);
+
+        auto word = word_.load (std::memory_order_relaxed);
+        while (holder_of (word) == h)
+        {
+            if (
+                word_.compare_exchange_weak (
+                    word, pack (desired_holder), std::memory_order_acq_rel
+                )
+            )
+            {
+                // our own load count is in the replaced word.
+                adjust (h, count_of (word) - 1);
+                return true;
+            }
+        }
+
+        // replaced by another writer between our load and compare exchange.
+        delete desired_holder;
+        release (h);
+        expected = load ();
+        return false;
+    }
+
+    bool compare_exchange_strong (Ptr & expected, Ptr desired)
+    {
+        return compare_exchange_weak (expected, std::move (desired));
+    }
+
+private:
+    struct holder
+    {
+        explicit holder (const Ptr & p) : value {p}
+        {
+        }
+
+        Ptr value;
+
+        // loads in progress on this holder that were transferred from the
+        // word by its replacer, less the loads that have since completed.
+        std::atomic <std::int64_t> count {0};
+    };
+
+    static constexpr unsigned pointer_bits = 48;
+    static constexpr std::uint64_t pointer_mask = (
+        (std::uint64_t {1} << pointer_bits) - 1
+    );
+    static constexpr std::uint64_t count_unit = (
+        std::uint64_t {1} << pointer_bits
+    );
+
+    static holder * make_holder (const Ptr & p)
+    {
+        return new holder {p};
+    }
+
+    static std::uint64_t pack (holder * h)
+    {
+        auto address = reinterpret_cast <std::uintptr_t> (h);
+        assert ((std::uint64_t {address} & ~pointer_mask) == 0);
+        return address;
+    }
+
+    static holder * holder_of (std::uint64_t word)
+    {
+        return reinterpret_cast <holder *> (
+            static_cast <std::uintptr_t> (word & pointer_mask)
+        );
+    }
+
+    static std::int64_t count_of (std::uint64_t word)
+    {
+        return static_cast <std::int64_t> (word >> pointer_bits);
+    }
+
+    static bool same_pointer (
+        const std::shared_ptr <typename Ptr::element_type> & a,
+        const std::shared_ptr <typename Ptr::element_type> & b
+    )
+    {
+        return a.get () == b.get ();
+    }
+
+    static bool same_pointer (
+        const std::weak_ptr <typename Ptr::element_type> &,
+        const std::weak_ptr <typename Ptr::element_type> &
+    )
+    {
+        return true;
+    }
+
+    static bool equivalent (const holder * h, const Ptr & expected)
+    {
+        if (! h)
+        {
+            return equivalent (Ptr {}, expected);
+        }
+
+        return equivalent (h->value, expected);
+    }
+
+    static bool equivalent (const Ptr & a, const Ptr & b)
+    {
+        return (
+            same_pointer (a, b) &&
+            ! a.owner_before (b) &&
+            ! b.owner_before (a)
+        );
+    }
+
+    //
+    // Start a load: count it in the word and return the current holder.
+    //
+    holder * acquire () const
+    {
+        return holder_of (
+            word_.fetch_add (count_unit, std::memory_order_acquire)
+        );
+    }
+
+    //
+    // Complete a load started on h. If h is still current, take the count
+    // back out of the word. Otherwise the replacer of h has transferred it
+    // to h.
+    //
+    void release (holder * h) const
+    {
+        auto word = word_.load (std::memory_order_relaxed);
+        while (holder_of (word) == h)
+        {
+            if (
+                word_.compare_exchange_weak (
+                    word, word - count_unit, std::memory_order_release,
+                    std::memory_order_relaxed
+                )
+            )
+            {
+                return;
+            }
+        }
+
+        adjust (h, -1);
+    }
+
+    //
+    // Add delta to the count of a replaced holder, deleting the holder if
+    // that completes the last load on it.
+    //
+    static void adjust (holder * h, std::int64_t delta)
+    {
+        if (! h)
+        {
+            return;
+        }
+
+        auto count = h->count.fetch_add (delta, std::memory_order_acq_rel);
+        if (count + delta == 0)
+        {
+            delete h;
+        }
+    }
+
+    mutable std::atomic <std::uint64_t> word_;
+};
+
+template <typename T>
+using atomic_shared_ptr = atomic_ptr <std::shared_ptr <T>>;
+
+template <typename T>
+using atomic_weak_ptr = atomic_ptr <std::weak_ptr <T>>;
+
+//
+// The following free functions mirror those of std for std::shared_ptr, so
+// that code written against std::atomic_load etc. works unchanged with
+// atomic_shared_ptr.
+//
+
+template <typename T>
+bool atomic_is_lock_free (const atomic_shared_ptr <T> * p)
+{
+    return p->is_lock_free ();
+}
+
+template <typename T>
+std::shared_ptr <T> atomic_load (const atomic_shared_ptr <T> * p)
+{
+    return p->load ();
+}
+
+//
+// Invoke reader on the current value, which must not be empty, while
+// holding it. Not in std. See also epoch_ptr, which reads without taking a
+// reference count.
+//
+template <typename T, typename Reader>
+auto atomic_read (const atomic_shared_ptr <T> * p, Reader && reader)
+    -> decltype (reader (std::declval <const T &> ()))
+{
+    auto value = p->load ();
+    return reader (static_cast <const T &> (* value));
+}
+
+template <typename T>
+void atomic_store (atomic_shared_ptr <T> * p, std::shared_ptr <T> r)
+{
+    p->store (std::move (r));
+}
+
+template <typename T>
+std::shared_ptr <T> atomic_exchange (
+    atomic_shared_ptr <T> * p,
+    std::shared_ptr <T> r
+)
+{
+    return p->exchange (std::move (r));
+}
+
+template <typename T>
+bool atomic_compare_exchange_weak (
+    atomic_shared_ptr <T> * p,
+    std::shared_ptr <T> * expected,
+    std::shared_ptr <T> desired
+)
+{
+    return p->compare_exchange_weak (* expected, std::move (desired));
+}
+
+template <typename T>
+bool atomic_compare_exchange_strong (
+    atomic_shared_ptr <T> * p,
+    std::shared_ptr <T> * expected,
+    std::shared_ptr <T> desired
+)
+{
+    return p->compare_exchange_strong (* expected, std::move (desired));
+}
+
+}
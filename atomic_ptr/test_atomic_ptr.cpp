@@ -0,0 +1,169 @@
+#include "atomic_ptr.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+using lockfree::atomic_shared_ptr;
+using lockfree::atomic_weak_ptr;
+using std::shared_ptr;
+using std::weak_ptr;
+using std::make_shared;
+using std::cout;
+
+void ok(bool cond, const std::string & what)
+{
+    cout << (cond ? "\nOK : " : "\nFAIL : ") << what;
+}
+
+//
+// Counts live instances, to check that no value leaks or is freed twice.
+//
+class counted
+{
+public:
+    explicit counted(int i) : i_(i)
+    {
+        ++live;
+    }
+
+    ~counted()
+    {
+        --live;
+        i_ = -1;
+    }
+
+    int value() const
+    {
+        return i_;
+    }
+
+    static std::atomic<int> live;
+
+private:
+    int i_;
+};
+
+std::atomic<int> counted::live{ 0 };
+
+void test_basic()
+{
+    {
+        atomic_shared_ptr<counted> p;
+        ok(!p.load(), "default is empty");
+        ok(p.is_lock_free(), "is_lock_free");
+
+        p.store(make_shared<counted>(1));
+        ok(p.load()->value() == 1, "store load");
+
+        auto old = p.exchange(make_shared<counted>(2));
+        ok(old->value() == 1 && p.load()->value() == 2, "exchange");
+
+        auto expected = old;
+        auto desired = make_shared<counted>(3);
+        ok(!p.compare_exchange_weak(expected, desired), "cas fail");
+        ok(expected->value() == 2, "cas fail loads expected");
+        ok(p.compare_exchange_weak(expected, desired), "cas");
+        ok(p.load() == desired, "cas stores desired");
+
+        // free function interface, as used by lockfree::map.
+        auto loaded = atomic_load(&p);
+        atomic_store(&p, make_shared<counted>(4));
+        ok(atomic_compare_exchange_weak(&p, &loaded, desired) == false, "cas");
+        ok(atomic_compare_exchange_weak(&p, &loaded, desired), "cas");
+        ok(atomic_exchange(&p, shared_ptr<counted>{})->value() == 3, "exch");
+        ok(!atomic_load(&p), "exchange empty");
+    }
+    ok(counted::live == 0, "no leak");
+}
+
+void test_weak()
+{
+    atomic_weak_ptr<counted> w;
+    ok(!w.load().lock(), "default is expired");
+
+    {
+        auto p = make_shared<counted>(5);
+        w.store(p);
+        ok(w.load().lock() == p, "weak load");
+    }
+    ok(!w.load().lock(), "weak expires");
+    ok(counted::live == 0, "weak does not own");
+}
+
+//
+// Readers load continuously while writers replace the value.
+// Every loaded value must be alive and one of the stored values.
+//
+void test_concurrent()
+{
+    constexpr int num_writers = 2;
+    constexpr int num_readers = 4;
+    constexpr int num_writes = 20000;
+
+    std::atomic<bool> stop{ false };
+    std::atomic<bool> bad{ false };
+    {
+        atomic_shared_ptr<counted> p{ make_shared<counted>(0) };
+
+        std::vector<std::thread> threads;
+        for (int r = 0; r < num_readers; ++r)
+        {
+            threads.emplace_back([&]() {
+                while (!stop)
+                {
+                    auto v = p.load();
+                    if (!v || v->value() < 0 || v->value() > num_writes)
+                    {
+                        bad = true;
+                    }
+                }
+            });
+        }
+
+        std::vector<std::thread> writers;
+        for (int w = 0; w < num_writers; ++w)
+        {
+            writers.emplace_back([&, w]() {
+                for (int i = 1; i <= num_writes; ++i)
+                {
+                    if (w == 0)
+                    {
+                        p.store(make_shared<counted>(i));
+                    }
+                    else
+                    {
+                        auto expected = p.load();
+                        p.compare_exchange_weak(
+                            expected, make_shared<counted>(i)
+                        );
+                    }
+                }
+            });
+        }
+
+        for (auto & t : writers)
+        {
+            t.join();
+        }
+        stop = true;
+        for (auto & t : threads)
+        {
+            t.join();
+        }
+    }
+
+    ok(!bad, "concurrent loads see live values");
+    ok(counted::live == 0, "concurrent no leak");
+}
+
+int main(int, char **)
+{
+    test_basic();
+    test_weak();
+    test_concurrent();
+    cout << "\ndone\n";
+    return 0;
+}
@@ -0,0 +1,269 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Harness shared by the benchmarks: timed multi-threaded runs, latency
+//      percentiles, key distributions and CSV output.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+/*
+Notes:
+1.  A run starts a number of threads at once, lets them call their
+    operation for a fixed duration, and counts the calls. Every
+    sample_every'th call is timed on its own for the latency percentiles,
+    so that reading the clock does not dominate short operations.
+2.  Results are printed as CSV, one line per run, to stdout.
+3.  --quick shortens every run and narrows the sweeps, for a smoke test.
+*/
+
+namespace benchmark
+{
+
+using clock = std::chrono::steady_clock;
+
+struct options
+{
+    std::chrono::milliseconds duration{200};
+    bool quick = false;
+
+    options(int argc, char ** argv)
+    {
+        for (int i = 1; i < argc; ++i)
+        {
+            if (std::strcmp(argv[i], "--quick") == 0)
+            {
+                quick = true;
+                duration = std::chrono::milliseconds{20};
+            }
+            else if (std::strcmp(argv[i], "--duration-ms") == 0 && i + 1 < argc)
+            {
+                duration = std::chrono::milliseconds{std::atoi(argv[++i])};
+            }
+            else
+            {
+                std::cerr << "usage: " << argv[0]
+                          << " [--quick] [--duration-ms N]\n";
+                std::exit(1);
+            }
+        }
+    }
+
+    //
+    // 1, 2, 4, ... up to the number of hardware threads, and that number.
+    //
+    std::vector<unsigned> thread_counts() const
+    {
+        unsigned hardware = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned> counts;
+        for (unsigned n = 1; n < hardware; n *= 2)
+        {
+            counts.push_back(n);
+        }
+        counts.push_back(hardware);
+        if (quick && counts.size() > 2)
+        {
+            counts.erase(counts.begin() + 1, counts.end() - 1);
+        }
+        return counts;
+    }
+};
+
+struct result
+{
+    std::uint64_t ops = 0;
+    double seconds = 0;
+    std::uint64_t p50_ns = 0;
+    std::uint64_t p99_ns = 0;
+    std::uint64_t p999_ns = 0;
+
+    double ops_per_sec() const
+    {
+        return seconds > 0 ? ops / seconds : 0;
+    }
+};
+
+constexpr unsigned sample_every = 8;
+
+//
+// Run for duration on threads. make_worker(thread) is called on each thread
+// and returns the operation, a callable void(), that the thread repeats.
+//
+template<class MakeWorker>
+result run(
+    unsigned threads,
+    std::chrono::milliseconds duration,
+    MakeWorker make_worker
+)
+{
+    std::atomic<unsigned> ready{0};
+    std::atomic<bool> go{false};
+    std::atomic<bool> stop{false};
+    std::vector<std::uint64_t> counts(threads);
+    std::vector<std::vector<std::uint64_t>> samples(threads);
+
+    std::vector<std::thread> workers;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        workers.emplace_back([&, t]() {
+            auto op = make_worker(t);
+            auto & latencies = samples[t];
+            latencies.reserve(1 << 16);
+
+            ++ready;
+            while (!go.load(std::memory_order_acquire))
+            {
+                std::this_thread::yield();
+            }
+
+            std::uint64_t n = 0;
+            while (!stop.load(std::memory_order_relaxed))
+            {
+                if (n % sample_every == 0)
+                {
+                    auto start = clock::now();
+                    op();
+                    latencies.push_back(
+                        std::chrono::duration_cast<std::chrono::nanoseconds>(
+                            clock::now() - start
+                        ).count()
+                    );
+                }
+                else
+                {
+                    op();
+                }
+                ++n;
+            }
+            counts[t] = n;
+        });
+    }
+
+    while (ready != threads)
+    {
+        std::this_thread::yield();
+    }
+    auto start = clock::now();
+    go.store(true, std::memory_order_release);
+    std::this_thread::sleep_for(duration);
+    stop = true;
+    for (auto & w : workers)
+    {
+        w.join();
+    }
+    auto elapsed = clock::now() - start;
+
+    result r;
+    r.seconds = std::chrono::duration<double>(elapsed).count();
+    std::vector<std::uint64_t> all;
+    for (unsigned t = 0; t < threads; ++t)
+    {
+        r.ops += counts[t];
+        all.insert(all.end(), samples[t].begin(), samples[t].end());
+    }
+    if (!all.empty())
+    {
+        std::sort(all.begin(), all.end());
+        auto at = [&all](double q) {
+            return all[std::min<std::size_t>(
+                all.size() - 1, static_cast<std::size_t>(q * all.size())
+            )];
+        };
+        r.p50_ns = at(0.5);
+        r.p99_ns = at(0.99);
+        r.p999_ns = at(0.999);
+    }
+    return r;
+}
+
+//
+// Zipfian ranks in [0, n), rank 0 the most frequent, as generated by YCSB
+// (Gray et al, Quickly generating billion-record synthetic databases).
+//
+class zipfian
+{
+public:
+    explicit zipfian(std::uint64_t n, double theta = 0.99) :
+        n_(n), theta_(theta)
+    {
+        double zeta_n = zeta(n, theta);
+        double zeta_2 = zeta(2, theta);
+        alpha_ = 1.0 / (1.0 - theta);
+        eta_ = (1.0 - std::pow(2.0 / n, 1.0 - theta)) / (1.0 - zeta_2 / zeta_n);
+        zeta_n_ = zeta_n;
+    }
+
+    template<class Random>
+    std::uint64_t operator()(Random & random) const
+    {
+        double u = std::uniform_real_distribution<double>(0, 1)(random);
+        double uz = u * zeta_n_;
+        if (uz < 1.0)
+        {
+            return 0;
+        }
+        if (uz < 1.0 + std::pow(0.5, theta_))
+        {
+            return 1;
+        }
+        auto rank = static_cast<std::uint64_t>(
+            n_ * std::pow(eta_ * u - eta_ + 1.0, alpha_)
+        );
+        return std::min(rank, n_ - 1);
+    }
+
+private:
+    static double zeta(std::uint64_t n, double theta)
+    {
+        double sum = 0;
+        for (std::uint64_t i = 1; i <= n; ++i)
+        {
+            sum += 1.0 / std::pow(static_cast<double>(i), theta);
+        }
+        return sum;
+    }
+
+    std::uint64_t n_;
+    double theta_;
+    double alpha_;
+    double eta_;
+    double zeta_n_;
+};
+
+//
+// CSV line of a run, after the columns that describe it.
+//
+inline void print(const std::string & description, const result & r)
+{
+    std::cout << description << ','
+              << r.ops << ','
+              << r.seconds << ','
+              << static_cast<std::uint64_t>(r.ops_per_sec()) << ','
+              << r.p50_ns << ','
+              << r.p99_ns << ','
+              << r.p999_ns << '\n'
+              << std::flush;
+}
+
+inline const char * result_header()
+{
+    return "ops,seconds,ops_per_sec,p50_ns,p99_ns,p999_ns";
+}
+
+}
@@ -0,0 +1,150 @@
+//
+// Lookups and iteration of lockfree::cache_optimized::map, whose every
+// snapshot is laid out in one arena, against lockfree::map, whose nodes
+// come from the general heap. Prints CSV to stdout.
+//
+// The heap is fragmented first, as in a long running process, so that the
+// nodes of lockfree::map are scattered over freed memory.
+//
+// Build and run, eg
+//      g++ -std=c++11 -O2 -pthread benchmark_locality.cpp -o locality
+//      ./locality > locality.csv
+//
+
+#include "benchmark.h"
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "../map/map.h"
+#include "../map/cache_optimized/map.h"
+
+using benchmark::options;
+
+//
+// Allocate blocks of node size and free a random half of them, leaving
+// the free lists of the heap shuffled.
+//
+std::vector<std::unique_ptr<char[]>> fragment_heap(std::size_t blocks)
+{
+    std::vector<std::unique_ptr<char[]>> kept(blocks);
+    for (auto & block : kept)
+    {
+        block.reset(new char[48]);
+    }
+
+    std::mt19937_64 random(7);
+    std::shuffle(kept.begin(), kept.end(), random);
+    kept.resize(blocks / 2);
+    return kept;
+}
+
+template<class Map>
+void measure(
+    const std::string & target,
+    const options & opts,
+    std::size_t size,
+    unsigned threads
+)
+{
+    std::vector<std::pair<int, int>> values;
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        values.emplace_back(static_cast<int>(i), static_cast<int>(i));
+    }
+
+    // one write, ie one clone, of all the elements.
+    auto noise = fragment_heap(4 * size);
+    Map m;
+    m.insert(values.begin(), values.end());
+
+    std::vector<std::vector<int>> keys(threads);
+    std::mt19937_64 random(size);
+    std::uniform_int_distribution<int> uniform(0, size - 1);
+    for (auto & k : keys)
+    {
+        for (int i = 0; i < 1 << 16; ++i)
+        {
+            k.push_back(uniform(random));
+        }
+    }
+
+    std::atomic<std::uint64_t> sink{0};
+
+    auto lookups = benchmark::run(
+        threads,
+        opts.duration,
+        [&](unsigned t) {
+            const auto & seq = keys[t];
+            std::size_t i = 0;
+            return [&, i]() mutable {
+                if (m.count(seq[i]) == 0)
+                {
+                    sink.fetch_add(1, std::memory_order_relaxed);
+                }
+                i = (i + 1) % seq.size();
+            };
+        }
+    );
+
+    // one operation is a whole pass over the snapshot.
+    auto iteration = benchmark::run(
+        threads,
+        opts.duration,
+        [&](unsigned) {
+            return [&]() {
+                std::uint64_t sum = 0;
+                for (const auto & item : m)
+                {
+                    sum += item.second;
+                }
+                sink.fetch_add(sum, std::memory_order_relaxed);
+            };
+        }
+    );
+
+    std::ostringstream description;
+    description << "locality," << target << ',' << size << ',' << threads;
+    benchmark::print(description.str() + ",lookup", lookups);
+    benchmark::print(description.str() + ",iteration", iteration);
+}
+
+int main(int argc, char ** argv)
+{
+    options opts(argc, argv);
+
+    std::cout << "benchmark,target,size,threads,operation,"
+              << benchmark::result_header() << '\n';
+
+    std::vector<std::size_t> sizes{10000, 1000000};
+    if (opts.quick)
+    {
+        sizes = {10000};
+    }
+
+    for (auto size : sizes)
+    {
+        for (auto threads : opts.thread_counts())
+        {
+            measure<lockfree::map<int, int>>(
+                "lockfree_map", opts, size, threads
+            );
+            measure<lockfree::cache_optimized::map<int, int>>(
+                "cache_optimized_map", opts, size, threads
+            );
+            measure<lockfree::unordered_map<int, int>>(
+                "lockfree_unordered_map", opts, size, threads
+            );
+            measure<lockfree::cache_optimized::unordered_map<int, int>>(
+                "cache_optimized_unordered_map", opts, size, threads
+            );
+        }
+    }
+
+    return 0;
+}
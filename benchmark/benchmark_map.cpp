@@ -0,0 +1,350 @@
+//
+// Throughput and latency of lockfree::map and lockfree::unordered_map
+// against std::map and std::unordered_map guarded by a std::mutex and by a
+// std::shared_mutex. Prints CSV to stdout.
+//
+// Build and run, eg
+//      g++ -std=c++17 -O2 -pthread benchmark_map.cpp -o benchmark_map
+//      ./benchmark_map > map.csv
+// The shared_mutex baselines need C++14 or later.
+//
+
+#include "benchmark.h"
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#if __cplusplus >= 201402L
+#include <shared_mutex>
+#endif
+
+#include "../map/map.h"
+
+using benchmark::options;
+
+//
+// Keys and mapped values of each type.
+//
+template<class T>
+T make(std::uint64_t i);
+
+template<>
+int make<int>(std::uint64_t i)
+{
+    return static_cast<int>(i);
+}
+
+template<>
+std::string make<std::string>(std::uint64_t i)
+{
+    // longer than the small string buffer, so copies allocate.
+    auto s = std::to_string(i);
+    return s + std::string(40 - s.size() % 40, 'k');
+}
+
+template<class T>
+const char * type_name();
+
+template<>
+const char * type_name<int>()
+{
+    return "int";
+}
+
+template<>
+const char * type_name<std::string>()
+{
+    return "string";
+}
+
+//
+// A map under test. get returns whether the key was found, put inserts or
+// assigns.
+//
+template<class Map>
+class lockfree_target
+{
+public:
+    using key_type = typename Map::key_type;
+    using mapped_type = typename Map::mapped_type;
+
+    explicit lockfree_target(typename Map::implementation_type && initial) :
+        map_(std::move(initial))
+    {
+    }
+
+    bool get(const key_type & key)
+    {
+        mapped_type mapped;
+        return map_.try_get(key, mapped);
+    }
+
+    void put(const key_type & key, const mapped_type & mapped)
+    {
+        map_.insert_or_assign(key, mapped);
+    }
+
+private:
+    Map map_;
+};
+
+template<class Map>
+class mutex_target
+{
+public:
+    using key_type = typename Map::key_type;
+    using mapped_type = typename Map::mapped_type;
+
+    explicit mutex_target(Map && initial) : map_(std::move(initial))
+    {
+    }
+
+    bool get(const key_type & key)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return map_.find(key) != map_.end();
+    }
+
+    void put(const key_type & key, const mapped_type & mapped)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        map_[key] = mapped;
+    }
+
+private:
+    std::mutex mutex_;
+    Map map_;
+};
+
+#if __cplusplus >= 201402L
+template<class Map>
+class shared_mutex_target
+{
+public:
+    using key_type = typename Map::key_type;
+    using mapped_type = typename Map::mapped_type;
+
+#if __cplusplus >= 201703L
+    using mutex_type = std::shared_mutex;
+#else
+    using mutex_type = std::shared_timed_mutex;
+#endif
+
+    explicit shared_mutex_target(Map && initial) : map_(std::move(initial))
+    {
+    }
+
+    bool get(const key_type & key)
+    {
+        std::shared_lock<mutex_type> lock(mutex_);
+        return map_.find(key) != map_.end();
+    }
+
+    void put(const key_type & key, const mapped_type & mapped)
+    {
+        std::unique_lock<mutex_type> lock(mutex_);
+        map_[key] = mapped;
+    }
+
+private:
+    mutex_type mutex_;
+    Map map_;
+};
+#endif
+
+//
+// Describes a run, ie the columns before the result.
+//
+struct workload
+{
+    const char * key_type;
+    std::size_t size;
+    unsigned threads;
+    unsigned read_percent;
+    const char * distribution;
+    // per thread sequences of key indexes, cycled through by the thread.
+    const std::vector<std::vector<std::uint32_t>> * indexes;
+};
+
+//
+// Run the workload on target and print its CSV line.
+//
+template<class Target, class Key, class Mapped>
+void measure(
+    const std::string & target_name,
+    const options & opts,
+    const workload & w,
+    const std::vector<Key> & keys,
+    const std::vector<Mapped> & values,
+    Target & target
+)
+{
+    auto r = benchmark::run(
+        w.threads,
+        opts.duration,
+        [&](unsigned t) {
+            const auto & seq = (*w.indexes)[t];
+            std::size_t i = 0;
+            // reads and writes interleaved by read_percent, with threads
+            // out of phase.
+            unsigned op = t * 37 % 100;
+            return [&, i, op]() mutable {
+                auto index = seq[i];
+                i = (i + 1) % seq.size();
+                op = (op + 1) % 100;
+                if (op < w.read_percent)
+                {
+                    target.get(keys[index]);
+                }
+                else
+                {
+                    target.put(keys[index], values[index]);
+                }
+            };
+        }
+    );
+
+    std::ostringstream description;
+    description << "map," << target_name << ',' << w.key_type << ','
+                << w.size << ',' << w.threads << ','
+                << w.read_percent << ',' << w.distribution;
+    benchmark::print(description.str(), r);
+}
+
+//
+// The targets over one Std map type, ie std::map or std::unordered_map.
+//
+template<class Std, class LockfreeMap>
+void run_targets(
+    const char * lockfree_name,
+    const char * std_name,
+    const options & opts,
+    const workload & w,
+    const std::vector<typename Std::key_type> & keys,
+    const std::vector<typename Std::mapped_type> & values
+)
+{
+    auto initial = [&]() {
+        Std m;
+        for (std::size_t i = 0; i < w.size; ++i)
+        {
+            m[keys[i]] = values[i];
+        }
+        return m;
+    };
+
+    {
+        lockfree_target<LockfreeMap> target{initial()};
+        measure(lockfree_name, opts, w, keys, values, target);
+    }
+    {
+        mutex_target<Std> target{initial()};
+        measure(
+            "mutex_" + std::string(std_name),
+            opts, w, keys, values, target
+        );
+    }
+#if __cplusplus >= 201402L
+    {
+        shared_mutex_target<Std> target{initial()};
+        measure(
+            "shared_mutex_" + std::string(std_name),
+            opts, w, keys, values, target
+        );
+    }
+#endif
+}
+
+template<class Key, class Mapped>
+void sweep(const options & opts)
+{
+    std::vector<std::size_t> sizes{1000, 100000};
+    std::vector<unsigned> read_percents{100, 95, 90, 50};
+    if (opts.quick)
+    {
+        sizes = {1000};
+        read_percents = {100, 50};
+    }
+    auto thread_counts = opts.thread_counts();
+    unsigned max_threads = thread_counts.back();
+
+    for (auto size : sizes)
+    {
+        std::vector<Key> keys;
+        std::vector<Mapped> values;
+        for (std::size_t i = 0; i < size; ++i)
+        {
+            keys.push_back(make<Key>(i));
+            values.push_back(make<Mapped>(i * 31));
+        }
+
+        // key indexes are drawn up front, so that drawing them is not
+        // measured.
+        std::mt19937_64 random(size);
+        std::uniform_int_distribution<std::uint32_t> uniform(0, size - 1);
+        benchmark::zipfian zipf(size);
+        std::vector<std::vector<std::uint32_t>> uniform_indexes(max_threads);
+        std::vector<std::vector<std::uint32_t>> zipf_indexes(max_threads);
+        for (unsigned t = 0; t < max_threads; ++t)
+        {
+            for (int i = 0; i < 1 << 16; ++i)
+            {
+                uniform_indexes[t].push_back(uniform(random));
+                zipf_indexes[t].push_back(
+                    static_cast<std::uint32_t>(zipf(random))
+                );
+            }
+        }
+
+        struct distribution
+        {
+            const char * name;
+            const std::vector<std::vector<std::uint32_t>> * indexes;
+        };
+        std::vector<distribution> distributions{
+            {"uniform", &uniform_indexes}, {"zipfian", &zipf_indexes}
+        };
+
+        for (const auto & d : distributions)
+        {
+            for (auto read_percent : read_percents)
+            {
+                for (auto threads : thread_counts)
+                {
+                    workload w{
+                        type_name<Key>(), size, threads, read_percent,
+                        d.name, d.indexes
+                    };
+                    run_targets<
+                        std::map<Key, Mapped>, lockfree::map<Key, Mapped>
+                    >("lockfree_map", "map", opts, w, keys, values);
+                    run_targets<
+                        std::unordered_map<Key, Mapped>,
+                        lockfree::unordered_map<Key, Mapped>
+                    >(
+                        "lockfree_unordered_map", "unordered_map",
+                        opts, w, keys, values
+                    );
+                }
+            }
+        }
+    }
+}
+
+int main(int argc, char ** argv)
+{
+    options opts(argc, argv);
+
+    std::cout << "benchmark,target,key_type,size,threads,read_percent,"
+              << "distribution," << benchmark::result_header() << '\n';
+
+    sweep<int, int>(opts);
+    sweep<std::string, std::string>(opts);
+
+    return 0;
+}
@@ -0,0 +1,130 @@
+//
+// Throughput and latency of lockfree::singleton::instance() against a
+// singleton guarded by a std::mutex and a function local static. Prints CSV
+// to stdout.
+//
+// Build and run, eg
+//      g++ -std=c++11 -O2 -pthread benchmark_singleton.cpp -o singleton
+//      ./singleton > singleton.csv
+//
+
+#include "benchmark.h"
+
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+
+#include "../singleton/singleton.h"
+
+using benchmark::options;
+
+class config
+{
+public:
+    config() : value_(17)
+    {
+    }
+
+    int value() const
+    {
+        return value_;
+    }
+
+private:
+    int value_;
+};
+
+//
+// Double checked locking done with a mutex on every call.
+//
+class mutex_singleton
+{
+public:
+    static std::shared_ptr<config> instance()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!instance_)
+        {
+            instance_ = std::make_shared<config>();
+        }
+        return instance_;
+    }
+
+private:
+    static std::mutex mutex_;
+    static std::shared_ptr<config> instance_;
+};
+
+std::mutex mutex_singleton::mutex_;
+std::shared_ptr<config> mutex_singleton::instance_;
+
+//
+// Function local static, initialized once by the compiler. Never released,
+// unlike the others.
+//
+config & static_instance()
+{
+    static config instance;
+    return instance;
+}
+
+//
+// Repeatedly get the instance and read it, while other threads do the
+// same.
+//
+template<class GetInstance>
+void measure(
+    const std::string & target,
+    const options & opts,
+    unsigned threads,
+    GetInstance get_instance
+)
+{
+    // a sink that the reads cannot be optimized away into.
+    std::atomic<int> sink{0};
+
+    auto r = benchmark::run(
+        threads,
+        opts.duration,
+        [&](unsigned) {
+            return [&]() {
+                if (get_instance() != 17)
+                {
+                    sink.fetch_add(1, std::memory_order_relaxed);
+                }
+            };
+        }
+    );
+
+    std::ostringstream description;
+    description << "singleton," << target << ',' << threads;
+    benchmark::print(description.str(), r);
+}
+
+int main(int argc, char ** argv)
+{
+    options opts(argc, argv);
+
+    std::cout << "benchmark,target,threads,"
+              << benchmark::result_header() << '\n';
+
+    // hold an instance, so that lockfree::singleton does not release and
+    // recreate it between calls.
+    auto held = lockfree::singleton<config>::instance();
+
+    for (auto threads : opts.thread_counts())
+    {
+        measure("lockfree_singleton", opts, threads, []() {
+            return lockfree::singleton<config>::instance()->value();
+        });
+        measure("mutex_singleton", opts, threads, []() {
+            return mutex_singleton::instance()->value();
+        });
+        measure("function_static", opts, threads, []() {
+            return static_instance().value();
+        });
+    }
+
+    return 0;
+}
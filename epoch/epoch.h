@@ -0,0 +1,505 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Epoch based memory reclamation in C++11, and an atomic pointer whose
+//      readers take no reference count.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+/*
+Notes:
+1.  A reader pins the current epoch in a record of its own thread for the
+    duration of a read, with an epoch_domain::guard. Pinning is a store and
+    a fence on the cache line of the thread record. Readers write no shared
+    cache line, so reads scale with the number of reader threads.
+2.  A writer retires an object it has unlinked. The object is freed once the
+    global epoch has advanced twice since, which requires every thread that
+    was pinned at the time to have unpinned. Retired objects are freed by
+    later retire and collect calls, by whichever thread makes them.
+    A collect advances the epoch as far as the pinned threads allow and frees
+    in the same pass, so with no thread pinned it frees every object retired
+    before it.
+3.  retire collects once the objects retired since the last collect are as
+    many as the objects that collect could not free, and at least
+    min_collect_threshold. So retirement costs amortized O(1), and with no
+    thread held up, only a few retired objects wait to be freed. Once writes
+    stop, the last few wait for an explicit collect:
+        lockfree::epoch_domain::instance ().collect ();
+    A retire of a large object can ask to collect right away instead.
+    epoch_ptr does, since the value it retires may be the last reference to
+    a whole version of a map, which a collect costs little next to. So a
+    replaced value is freed as soon as no thread is pinned to it at the next
+    write.
+4.  A thread that stays pinned holds up all reclamation. Do not keep a guard
+    across blocking calls.
+5.  Thread records are reused by later threads.
+6.  The domain is never destroyed, so that an epoch_ptr of static storage
+    duration can retire its value into it at exit, whatever the order of
+    destruction of statics. Objects still retired at exit are not freed.
+*/
+
+namespace lockfree
+{
+
+class epoch_domain
+{
+    //
+    // Record of a thread. Padded so that records of different threads do
+    // not share a cache line.
+    //
+    struct record
+    {
+        // pinned epoch, or 0 when not pinned.
+        std::atomic <std::uint64_t> epoch {0};
+        std::atomic <bool> in_use {true};
+        record * next = nullptr;
+
+        // only accessed by the owning thread.
+        unsigned nesting = 0;
+
+        char padding [64];
+    };
+
+public:
+    //
+    // The one domain, shared by all epoch_ptrs. There is one domain only,
+    // since a thread caches its record.
+    // Never destroyed. See Note 6.
+    //
+    static epoch_domain & instance ()
+    {
+        static epoch_domain & domain = * new epoch_domain;
+        return domain;
+    }
+
+    epoch_domain (const epoch_domain &) = delete;
+    epoch_domain & operator = (const epoch_domain &) = delete;
+
+    //
+    // Pins the calling thread to the current epoch for its lifetime.
+    // Guards nest.
+    //
+    class guard
+    {
+    public:
+        guard () : record_ {instance ().local_record ()}
+        {
+            if (record_->nesting ++ == 0)
+            {
+                record_->epoch.store (
+                    instance ().epoch_.load (std::memory_order_relaxed),
+                    std::memory_order_relaxed
+                );
+                // the pin must be visible before the reads it protects.
+                std::atomic_thread_fence (std::memory_order_seq_cst);
+            }
+        }
+
+        ~guard ()
+        {
+            if (-- record_->nesting == 0)
+            {
+                record_->epoch.store (0, std::memory_order_release);
+            }
+        }
+
+        guard (const guard &) = delete;
+        guard & operator = (const guard &) = delete;
+
+    private:
+        record * record_;
+    };
+
+    //
+    // Free p with deleter once no thread can be reading it. p must already
+    // be unreachable for new readers. collect_now collects whatever the
+    // threshold, eg for a p that holds much memory. See Note 3.
+    //
+    void retire (
+        void * p,
+        void (* deleter) (void *),
+        bool collect_now = false
+    )
+    {
+        auto r = new retired {
+            p, deleter, epoch_.load (std::memory_order_acquire), nullptr
+        };
+        push_retired (r, r);
+
+        if (
+            retired_count_.fetch_add (1, std::memory_order_relaxed) + 1 >=
+                collect_threshold_.load (std::memory_order_relaxed) ||
+            collect_now
+        )
+        {
+            collect ();
+        }
+    }
+
+    //
+    // Advance the epoch as far as the pinned threads allow, and free the
+    // retired objects that are then safe to free. See Notes 2 and 3.
+    //
+    void collect ()
+    {
+        // an object retired in the current epoch is safe to free two
+        // epochs later.
+        for (int i = 0; i < 2 && try_advance (); ++ i)
+        {
+        }
+
+        auto list = retired_.exchange (nullptr, std::memory_order_acquire);
+        auto epoch = epoch_.load (std::memory_order_acquire);
+        retired_count_.store (0, std::memory_order_relaxed);
+
+        auto threshold = free_retired (list, epoch);
+        if (threshold < min_collect_threshold)
+        {
+            threshold = min_collect_threshold;
+        }
+        collect_threshold_.store (threshold, std::memory_order_relaxed);
+    }
+
+private:
+    epoch_domain () = default;
+
+    struct retired
+    {
+        void * p;
+        void (* deleter) (void *);
+        std::uint64_t epoch;
+        retired * next;
+    };
+
+    //
+    // Owner of the record of a thread. Releases it for reuse when the
+    // thread exits.
+    //
+    struct record_owner
+    {
+        ~record_owner ()
+        {
+            if (r)
+            {
+                r->in_use.store (false, std::memory_order_release);
+            }
+        }
+
+        record * r = nullptr;
+    };
+
+    static constexpr std::size_t min_collect_threshold = 8;
+
+    record * local_record ()
+    {
+        static thread_local record_owner owner;
+        if (! owner.r)
+        {
+            owner.r = acquire_record ();
+        }
+
+        return owner.r;
+    }
+
+    record * acquire_record ()
+    {
+        for (auto r = records_.load (std::memory_order_acquire); r; r = r->next)
+        {
+            bool in_use = false;
+            if (r->in_use.compare_exchange_strong (in_use, true))
+            {
+                return r;
+            }
+        }
+
+        auto r = new record;
+        r->next = records_.load (std::memory_order_relaxed);
+        while ( !
+            records_.compare_exchange_weak (
+                r->next, r, std::memory_order_release
+            )
+        );
+
+        return r;
+    }
+
+    //
+    // The epoch advances only when every pinned thread is pinned at it.
+    // Returns false if a pinned thread holds it up, and true if it advanced,
+    // by this or another thread.
+    //
+    bool try_advance ()
+    {
+        auto epoch = epoch_.load (std::memory_order_acquire);
+        std::atomic_thread_fence (std::memory_order_seq_cst);
+
+        for (auto r = records_.load (std::memory_order_acquire); r; r = r->next)
+        {
+            auto pinned = r->epoch.load (std::memory_order_acquire);
+            if (pinned != 0 && pinned != epoch)
+            {
+                return false;
+            }
+        }
+
+        epoch_.compare_exchange_strong (epoch, epoch + 1);
+        return true;
+    }
+
+    void push_retired (retired * first, retired * last)
+    {
+        last->next = retired_.load (std::memory_order_relaxed);
+        while ( !
+            retired_.compare_exchange_weak (
+                last->next, first, std::memory_order_release
+            )
+        );
+    }
+
+    //
+    // Free the objects in list retired at least two epochs before epoch.
+    // The rest go back to the retired list. Returns how many went back.
+    //
+    std::size_t free_retired (retired * list, std::uint64_t epoch)
+    {
+        std::size_t kept = 0;
+        retired * keep_first = nullptr;
+        retired * keep_last = nullptr;
+        while (list)
+        {
+            auto next = list->next;
+            if (list->epoch + 2 <= epoch)
+            {
+                list->deleter (list->p);
+                delete list;
+            }
+            else
+            {
+                ++ kept;
+                list->next = keep_first;
+                keep_first = list;
+                if (! keep_last)
+                {
+                    keep_last = list;
+                }
+            }
+            list = next;
+        }
+
+        if (keep_first)
+        {
+            push_retired (keep_first, keep_last);
+        }
+
+        return kept;
+    }
+
+    // epochs start at 1, since 0 marks a record that is not pinned.
+    std::atomic <std::uint64_t> epoch_ {1};
+    std::atomic <record *> records_ {nullptr};
+    std::atomic <retired *> retired_ {nullptr};
+    std::atomic <std::size_t> retired_count_ {0};
+    std::atomic <std::size_t> collect_threshold_ {min_collect_threshold};
+};
+
+//
+// Atomic shared_ptr, whose value can also be read without taking a
+// reference count, by read() under an epoch guard.
+// Replaced values are retired to the epoch_domain, so a value lives until
+// both its last shared_ptr is gone and no reader can be reading it.
+//
+template <typename T>
+class epoch_ptr
+{
+public:
+    using value_type = std::shared_ptr <T>;
+
+    constexpr epoch_ptr () noexcept : node_ {nullptr}
+    {
+    }
+
+    epoch_ptr (const epoch_ptr &) = delete;
+    epoch_ptr & operator = (const epoch_ptr &) = delete;
+
+    ~epoch_ptr ()
+    {
+        retire (node_.load (std::memory_order_relaxed));
+    }
+
+    bool is_lock_free () const noexcept
+    {
+        return node_.is_lock_free ();
+    }
+
+    std::shared_ptr <T> load () const
+    {
+        epoch_domain::guard g;
+
+        return value_of (node_.load (std::memory_order_acquire));
+    }
+
+    //
+    // Invoke reader on the current value, which must not be empty, with no
+    // reference count taken. reader must not keep references to the value.
+    //
+    template <typename Reader>
+    auto read (Reader && reader) const
+        -> decltype (reader (std::declval <const T &> ()))
+    {
+        epoch_domain::guard g;
+
+        const T & value = * node_.load (std::memory_order_acquire)->value;
+        return reader (value);
+    }
+
+    void store (std::shared_ptr <T> desired)
+    {
+        retire (
+            node_.exchange (
+                new node {std::move (desired)}, std::memory_order_acq_rel
+            )
+        );
+    }
+
+    std::shared_ptr <T> exchange (std::shared_ptr <T> desired)
+    {
+        auto replaced = node_.exchange (
+            new node {std::move (desired)}, std::memory_order_acq_rel
+        );
+
+        // the replaced node lives at least until it is retired.
+        auto value = value_of (replaced);
+        retire (replaced);
+
+        return value;
+    }
+
+    //
+    // Fails only if the value is not expected, ie does not hold the same
+    // pointer with the same ownership, in which case the value is loaded
+    // into expected.
+    //
+    bool compare_exchange_weak (
+        std::shared_ptr <T> & expected,
+        std::shared_ptr <T> desired
+    )
+    {
+        epoch_domain::guard g;
+
+        auto current = node_.load (std::memory_order_acquire);
+        const auto & value = current ? current->value : empty_;
+        if (
+            value != expected ||
+            value.owner_before (expected) ||
+            expected.owner_before (value)
+        )
+        {
+            expected = value;
+            return false;
+        }
+
+        auto n = new node {std::move (desired)};
+        if (
+            node_.compare_exchange_strong (
+                current, n, std::memory_order_acq_rel
+            )
+        )
+        {
+            retire (current);
+            return true;
+        }
+
+        // current was replaced since the guard is held, so it is not freed.
+        expected = value_of (current);
+        delete n;
+        return false;
+    }
+
+private:
+    struct node
+    {
+        std::shared_ptr <T> value;
+    };
+
+    static std::shared_ptr <T> value_of (const node * n)
+    {
+        return n ? n->value : std::shared_ptr <T> {};
+    }
+
+    static void retire (node * n)
+    {
+        if (n)
+        {
+            // n may hold the last reference to a large value, so collect
+            // right away. See Note 3.
+            epoch_domain::instance ().retire (
+                n, [] (void * p) { delete static_cast <node *> (p); }, true
+            );
+        }
+    }
+
+    static const std::shared_ptr <T> empty_;
+
+    std::atomic <node *> node_;
+};
+
+template <typename T>
+const std::shared_ptr <T> epoch_ptr <T>::empty_;
+
+//
+// The following free functions mirror those of std for std::shared_ptr.
+// See also atomic_ptr.h
+//
+
+template <typename T>
+bool atomic_is_lock_free (const epoch_ptr <T> * p)
+{
+    return p->is_lock_free ();
+}
+
+template <typename T>
+std::shared_ptr <T> atomic_load (const epoch_ptr <T> * p)
+{
+    return p->load ();
+}
+
+template <typename T, typename Reader>
+auto atomic_read (const epoch_ptr <T> * p, Reader && reader)
+    -> decltype (reader (std::declval <const T &> ()))
+{
+    return p->read (std::forward <Reader> (reader));
+}
+
+template <typename T>
+void atomic_store (epoch_ptr <T> * p, std::shared_ptr <T> r)
+{
+    p->store (std::move (r));
+}
+
+template <typename T>
+std::shared_ptr <T> atomic_exchange (epoch_ptr <T> * p, std::shared_ptr <T> r)
+{
+    return p->exchange (std::move (r));
+}
+
+template <typename T>
+bool atomic_compare_exchange_weak (
+    epoch_ptr <T> * p,
+    std::shared_ptr <T> * expected,
+    std::shared_ptr <T> desired
+)
+{
+    return p->compare_exchange_weak (* expected, std::move (desired));
+}
+
+}
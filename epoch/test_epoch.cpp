@@ -0,0 +1,287 @@
+#include "epoch.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+
+using lockfree::epoch_domain;
+using lockfree::epoch_ptr;
+using std::shared_ptr;
+using std::make_shared;
+using std::cout;
+
+void ok(bool cond, const std::string & what)
+{
+    cout << (cond ? "\nOK : " : "\nFAIL : ") << what;
+}
+
+//
+// Counts live instances, to check that no value leaks or is freed early.
+//
+class counted
+{
+public:
+    explicit counted(int i) : i_(i)
+    {
+        ++live;
+    }
+
+    ~counted()
+    {
+        --live;
+        i_ = -1;
+    }
+
+    int value() const
+    {
+        return i_;
+    }
+
+    static std::atomic<int> live;
+
+private:
+    int i_;
+};
+
+std::atomic<int> counted::live{ 0 };
+
+void delete_counted(void * p)
+{
+    delete static_cast<counted *>(p);
+}
+
+//
+// An object retired while a thread is pinned outlives that pin.
+//
+void test_domain()
+{
+    auto & domain = epoch_domain::instance();
+
+    std::atomic<int> stage{ 0 };
+    std::thread reader([&]() {
+        epoch_domain::guard g;
+        stage = 1;
+        while (stage != 2)
+        {
+            std::this_thread::yield();
+        }
+    });
+    while (stage != 1)
+    {
+        std::this_thread::yield();
+    }
+
+    domain.retire(new counted(1), delete_counted);
+    for (int i = 0; i < 4; ++i)
+    {
+        domain.collect();
+    }
+    ok(counted::live == 1, "retired is kept while pinned");
+
+    stage = 2;
+    reader.join();
+    for (int i = 0; i < 4; ++i)
+    {
+        domain.collect();
+    }
+    ok(counted::live == 0, "retired is freed once unpinned");
+
+    {
+        epoch_domain::guard outer;
+        {
+            epoch_domain::guard inner;
+        }
+        domain.retire(new counted(2), delete_counted);
+        for (int i = 0; i < 4; ++i)
+        {
+            domain.collect();
+        }
+        ok(counted::live == 1, "nested guard keeps the pin");
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        domain.collect();
+    }
+    ok(counted::live == 0, "retired is freed once the outer guard is gone");
+}
+
+//
+// With no thread pinned, retired objects are freed as more are retired,
+// and one collect frees them all.
+//
+void test_collect()
+{
+    auto & domain = epoch_domain::instance();
+    domain.collect();
+
+    for (int i = 0; i < 1000; ++i)
+    {
+        domain.retire(new counted(i), delete_counted);
+    }
+    ok(counted::live <= 8, "retired are freed while retiring");
+
+    domain.collect();
+    ok(counted::live == 0, "one collect frees all retired");
+
+    {
+        epoch_domain::guard g;
+        domain.retire(new counted(1), delete_counted);
+        domain.collect();
+        ok(counted::live == 1, "collect keeps retired while pinned");
+    }
+    domain.collect();
+    ok(counted::live == 0, "one collect frees once unpinned");
+}
+
+void test_ptr()
+{
+    {
+        epoch_ptr<counted> p;
+        ok(!p.load(), "default is empty");
+        ok(p.is_lock_free(), "is_lock_free");
+
+        p.store(make_shared<counted>(1));
+        ok(p.load()->value() == 1, "store load");
+        ok(
+            p.read([](const counted & c) { return c.value(); }) == 1,
+            "read"
+        );
+
+        auto old = p.exchange(make_shared<counted>(2));
+        ok(old->value() == 1 && p.load()->value() == 2, "exchange");
+
+        auto expected = old;
+        auto desired = make_shared<counted>(3);
+        ok(!p.compare_exchange_weak(expected, desired), "cas fail");
+        ok(expected->value() == 2, "cas fail loads expected");
+        ok(p.compare_exchange_weak(expected, desired), "cas");
+        ok(p.load() == desired, "cas stores desired");
+
+        // free function interface, as used by lockfree::map.
+        auto loaded = atomic_load(&p);
+        atomic_store(&p, make_shared<counted>(4));
+        ok(!atomic_compare_exchange_weak(&p, &loaded, desired), "cas");
+        ok(atomic_compare_exchange_weak(&p, &loaded, desired), "cas");
+        ok(
+            atomic_read(&p, [](const counted & c) { return c.value(); }) == 3,
+            "atomic_read"
+        );
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        epoch_domain::instance().collect();
+    }
+    ok(counted::live == 0, "values freed after grace period");
+}
+
+//
+// A replaced value is freed by the write that replaces it, with no
+// explicit collect, once no reader is pinned.
+//
+void test_replaced_freed()
+{
+    epoch_ptr<counted> p;
+    p.store(make_shared<counted>(1));
+    p.store(make_shared<counted>(2));
+    ok(counted::live == 1, "replaced value freed by store");
+
+    {
+        epoch_domain::guard g;
+        auto expected = p.load();
+        p.compare_exchange_weak(expected, make_shared<counted>(3));
+        ok(counted::live == 2, "replaced value kept while pinned");
+    }
+    p.exchange(make_shared<counted>(4));
+    ok(counted::live == 1, "replaced values freed once unpinned");
+
+    p.store(nullptr);
+    ok(counted::live == 0, "last value freed by store");
+}
+
+//
+// Readers read continuously while writers replace the value.
+// Every value read must be alive and one of the stored values.
+//
+void test_concurrent()
+{
+    constexpr int num_writers = 2;
+    constexpr int num_readers = 4;
+    constexpr int num_writes = 20000;
+
+    std::atomic<bool> stop{ false };
+    std::atomic<bool> bad{ false };
+    {
+        epoch_ptr<counted> p;
+        p.store(make_shared<counted>(0));
+
+        std::vector<std::thread> threads;
+        for (int r = 0; r < num_readers; ++r)
+        {
+            threads.emplace_back([&]() {
+                while (!stop)
+                {
+                    auto v = p.read([](const counted & c) {
+                        return c.value();
+                    });
+                    if (v < 0 || v > num_writes)
+                    {
+                        bad = true;
+                    }
+                }
+            });
+        }
+
+        std::vector<std::thread> writers;
+        for (int w = 0; w < num_writers; ++w)
+        {
+            writers.emplace_back([&, w]() {
+                for (int i = 1; i <= num_writes; ++i)
+                {
+                    if (w == 0)
+                    {
+                        p.store(make_shared<counted>(i));
+                    }
+                    else
+                    {
+                        auto expected = p.load();
+                        p.compare_exchange_weak(
+                            expected, make_shared<counted>(i)
+                        );
+                    }
+                }
+            });
+        }
+
+        for (auto & t : writers)
+        {
+            t.join();
+        }
+        stop = true;
+        for (auto & t : threads)
+        {
+            t.join();
+        }
+    }
+
+    for (int i = 0; i < 4; ++i)
+    {
+        epoch_domain::instance().collect();
+    }
+    ok(!bad, "concurrent reads see live values");
+    ok(counted::live == 0, "concurrent no leak");
+}
+
+int main(int, char **)
+{
+    test_domain();
+    test_collect();
+    test_ptr();
+    test_replaced_freed();
+    test_concurrent();
+    cout << "\ndone\n";
+    return 0;
+}
@@ -0,0 +1,1272 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Persistent B+ tree for use as the Implementation of
+//      lockfree::map_template.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "map.h"
+
+/*
+Notes:
+1.  btree_map is an ordered map with the interface of std::map that
+    map_template needs. It is a B+ tree whose nodes are a few cache lines
+    wide. Leaves hold the elements in place, and inner nodes hold their
+    separator keys apart from their children, so a lookup touches
+    O(log_B n) mostly contiguous nodes instead of O(log2 n) scattered
+    red-black tree nodes.
+2.  Nodes are shared between copies of a btree_map. Copy construction only
+    copies the root pointer. A write copies the path from the root to the
+    changed leaf, plus a sibling when nodes are split or merged, and shares
+    all other nodes. So the cost of a lockfree write no longer grows with
+    the size of the map.
+3.  A node is never changed once it is reachable from more than one
+    btree_map. Nodes that are exclusively owned, ie nodes already copied by
+    an earlier write to the same btree_map, are changed in place.
+4.  Unlike std::map, every write invalidates all iterators, pointers and
+    references to elements, like std::vector does.
+*/
+
+namespace lockfree
+{
+
+template <
+    typename Key,
+    typename Mapped,
+    typename Compare = std::less <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+class btree_map
+{
+public:
+    using key_type = Key;
+    using mapped_type = Mapped;
+    using value_type = std::pair <const Key, Mapped>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using key_compare = Compare;
+    using allocator_type = Allocator;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+
+private:
+    //
+    // Nodes are sized to a few cache lines. The elements of a leaf, and the
+    // keys of an inner node together with its children, take up to
+    // node_bytes, with at least min_capacity of them.
+    //
+    static constexpr std::size_t node_bytes = 256;
+    static constexpr std::size_t min_capacity = 8;
+    static constexpr std::size_t leaf_capacity = (
+        node_bytes / sizeof (value_type) > min_capacity ?
+        node_bytes / sizeof (value_type) : min_capacity
+    );
+    static constexpr std::size_t inner_capacity = (
+        2 * node_bytes / (sizeof (key_type) + sizeof (void *) * 2) >
+            min_capacity ?
+        2 * node_bytes / (sizeof (key_type) + sizeof (void *) * 2) :
+            min_capacity
+    );
+
+    template <typename T>
+    using storage =
+        typename std::aligned_storage <sizeof (T), alignof (T)>::type;
+
+    //
+    // count is the number of elements of a leaf, or the number of children
+    // of an inner node. An inner node with count children has count - 1
+    // keys, where key i is not greater than any key under child i + 1, and
+    // greater than every key under child i.
+    // Both have room for one more than their capacity, which is split off
+    // right after it is inserted.
+    //
+    struct node
+    {
+        explicit node (bool is_leaf) : leaf {is_leaf}
+        {
+        }
+
+        const bool leaf;
+        std::size_t count = 0;
+    };
+
+    using node_ptr = std::shared_ptr <node>;
+
+    struct leaf_node : node
+    {
+        leaf_node () : node {true}
+        {
+        }
+
+        leaf_node (const leaf_node & other) : node {true}
+        {
+            try
+            {
+                for (; this->count < other.count; ++ this->count)
+                {
+                    new (& slots [this->count]) value_type (
+                        other.entry (this->count)
+                    );
+                }
+            }
+            catch (...)
+            {
+                destroy ();
+                throw;
+            }
+        }
+
+        ~leaf_node ()
+        {
+            destroy ();
+        }
+
+        void destroy ()
+        {
+            for (std::size_t i = 0; i < this->count; ++ i)
+            {
+                entry (i).~value_type ();
+            }
+        }
+
+        value_type & entry (std::size_t i)
+        {
+            return * reinterpret_cast <value_type *> (& slots [i]);
+        }
+
+        const value_type & entry (std::size_t i) const
+        {
+            return * reinterpret_cast <const value_type *> (& slots [i]);
+        }
+
+        storage <value_type> slots [leaf_capacity + 1];
+    };
+
+    struct inner_node : node
+    {
+        inner_node () : node {false}
+        {
+        }
+
+        inner_node (const inner_node & other) : node {false}
+        {
+            try
+            {
+                for (; this->count + 1 < other.count; ++ this->count)
+                {
+                    new (& keys [this->count]) key_type (
+                        other.key (this->count)
+                    );
+                    children [this->count] = other.children [this->count];
+                }
+                children [this->count] = other.children [this->count];
+                ++ this->count;
+            }
+            catch (...)
+            {
+                destroy ();
+                throw;
+            }
+        }
+
+        ~inner_node ()
+        {
+            destroy ();
+        }
+
+        void destroy ()
+        {
+            for (std::size_t i = 0; i + 1 < this->count; ++ i)
+            {
+                key (i).~key_type ();
+            }
+        }
+
+        key_type & key (std::size_t i)
+        {
+            return * reinterpret_cast <key_type *> (& keys [i]);
+        }
+
+        const key_type & key (std::size_t i) const
+        {
+            return * reinterpret_cast <const key_type *> (& keys [i]);
+        }
+
+        storage <key_type> keys [inner_capacity];
+        node_ptr children [inner_capacity + 1];
+    };
+
+    static leaf_node & as_leaf (node & n)
+    {
+        return static_cast <leaf_node &> (n);
+    }
+
+    static const leaf_node & as_leaf (const node & n)
+    {
+        return static_cast <const leaf_node &> (n);
+    }
+
+    static inner_node & as_inner (node & n)
+    {
+        return static_cast <inner_node &> (n);
+    }
+
+    static const inner_node & as_inner (const node & n)
+    {
+        return static_cast <const inner_node &> (n);
+    }
+
+public:
+    //
+    // An iterator re-descends from the root when it steps off a leaf, which
+    // is once every O(B) elements. That keeps it three pointers small.
+    //
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename btree_map::value_type;
+        using difference_type = typename btree_map::difference_type;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+
+        const_iterator () = default;
+
+        reference operator * () const
+        {
+            return leaf_->entry (pos_);
+        }
+
+        pointer operator -> () const
+        {
+            return & leaf_->entry (pos_);
+        }
+
+        const_iterator & operator ++ ()
+        {
+            if (++ pos_ == leaf_->count)
+            {
+                * this = tree_->next_leaf (leaf_->entry (pos_ - 1).first);
+            }
+            return * this;
+        }
+
+        const_iterator operator ++ (int)
+        {
+            auto itr = * this;
+            ++ (* this);
+            return itr;
+        }
+
+        bool operator == (const const_iterator & other) const
+        {
+            return leaf_ == other.leaf_ && pos_ == other.pos_;
+        }
+
+        bool operator != (const const_iterator & other) const
+        {
+            return ! (* this == other);
+        }
+
+    private:
+        const_iterator (
+            const btree_map * tree,
+            const leaf_node * leaf,
+            std::size_t pos
+        ) : tree_ {tree}, leaf_ {leaf}, pos_ {pos}
+        {
+        }
+
+        const btree_map * tree_ = nullptr;
+        const leaf_node * leaf_ = nullptr;
+        std::size_t pos_ = 0;
+
+        friend btree_map;
+    };
+
+    // all elements are immutable through an iterator, as in std::set.
+    using iterator = const_iterator;
+
+    btree_map () = default;
+
+    explicit btree_map (
+        const key_compare & compare,
+        const allocator_type & allocator = allocator_type {}
+    ) : compare_ {compare}, allocator_ {allocator}
+    {
+    }
+
+    explicit btree_map (const allocator_type & allocator) :
+        allocator_ {allocator}
+    {
+    }
+
+    btree_map (
+        std::initializer_list <value_type> init,
+        const key_compare & compare = key_compare {},
+        const allocator_type & allocator = allocator_type {}
+    ) : compare_ {compare}, allocator_ {allocator}
+    {
+        insert (init.begin (), init.end ());
+    }
+
+    template <class InputIterator>
+    btree_map (
+        InputIterator first,
+        InputIterator last,
+        const key_compare & compare = key_compare {},
+        const allocator_type & allocator = allocator_type {}
+    ) : compare_ {compare}, allocator_ {allocator}
+    {
+        insert (first, last);
+    }
+
+    //
+    // From a range sorted by key, with no two equal keys, in O(n). The tree
+    // is built bottom up, a level at a time, so every node is full but the
+    // last one or two of each level, which are at least half full.
+    // Throws std::invalid_argument if the range is not sorted and unique.
+    //
+    template <class InputIterator>
+    btree_map (
+        sorted_unique_t,
+        InputIterator first,
+        InputIterator last,
+        const key_compare & compare = key_compare {},
+        const allocator_type & allocator = allocator_type {}
+    ) : compare_ {compare}, allocator_ {allocator}
+    {
+        build_sorted (first, last);
+    }
+
+    //
+    // Copy construction shares all nodes with other. O(1).
+    //
+    btree_map (const btree_map & other) = default;
+
+    btree_map (btree_map && other) noexcept :
+        root_ {std::move (other.root_)},
+        size_ {other.size_},
+        compare_ {std::move (other.compare_)},
+        allocator_ {other.allocator_}
+    {
+        other.size_ = 0;
+    }
+
+    btree_map & operator = (const btree_map & other) = default;
+
+    btree_map & operator = (btree_map && other) noexcept
+    {
+        if (this != & other)
+        {
+            root_ = std::move (other.root_);
+            size_ = other.size_;
+            compare_ = std::move (other.compare_);
+            allocator_ = other.allocator_;
+            other.size_ = 0;
+        }
+
+        return * this;
+    }
+
+    const_iterator begin () const noexcept
+    {
+        if (! root_)
+        {
+            return end ();
+        }
+
+        auto n = root_.get ();
+        while (! n->leaf)
+        {
+            n = as_inner (* n).children [0].get ();
+        }
+
+        return const_iterator {this, & as_leaf (* n), 0};
+    }
+
+    const_iterator end () const noexcept
+    {
+        return const_iterator {};
+    }
+
+    const_iterator cbegin () const noexcept
+    {
+        return begin ();
+    }
+
+    const_iterator cend () const noexcept
+    {
+        return end ();
+    }
+
+    bool empty () const noexcept
+    {
+        return size_ == 0;
+    }
+
+    size_type size () const noexcept
+    {
+        return size_;
+    }
+
+    //
+    // Elements and bytes copied by copy construction, for the stats of a
+    // map_template. None, since copies share all nodes.
+    //
+    std::pair <size_type, std::size_t> clone_cost () const noexcept
+    {
+        return std::make_pair (size_type {0}, std::size_t {0});
+    }
+
+    size_type max_size () const noexcept
+    {
+        return std::numeric_limits <difference_type>::max () /
+            sizeof (value_type);
+    }
+
+    allocator_type get_allocator () const noexcept
+    {
+        return allocator_;
+    }
+
+    key_compare key_comp () const
+    {
+        return compare_;
+    }
+
+    const_iterator find (const key_type & key) const
+    {
+        auto leaf = descend (key);
+        if (leaf)
+        {
+            auto pos = lower_index (* leaf, key);
+            if (
+                pos < leaf->count &&
+                ! compare_ (key, leaf->entry (pos).first)
+            )
+            {
+                return const_iterator {this, leaf, pos};
+            }
+        }
+
+        return end ();
+    }
+
+    size_type count (const key_type & key) const
+    {
+        return find (key) == end () ? 0 : 1;
+    }
+
+    const mapped_type & at (const key_type & key) const
+    {
+        auto itr = find (key);
+        if (itr == end ())
+        {
+            throw std::out_of_range {"btree_map::at"};
+        }
+
+        return itr->second;
+    }
+
+    //
+    // first element whose key is not less than key.
+    //
+    const_iterator lower_bound (const key_type & key) const
+    {
+        auto leaf = descend (key);
+        if (! leaf)
+        {
+            return end ();
+        }
+
+        return at_or_next (leaf, lower_index (* leaf, key));
+    }
+
+    //
+    // first element whose key is greater than key.
+    //
+    const_iterator upper_bound (const key_type & key) const
+    {
+        auto leaf = descend (key);
+        if (! leaf)
+        {
+            return end ();
+        }
+
+        return at_or_next (leaf, upper_index (* leaf, key));
+    }
+
+    std::pair <const_iterator, const_iterator>
+    equal_range (const key_type & key) const
+    {
+        auto first = find (key);
+        auto last = first;
+        if (last != end ())
+        {
+            ++ last;
+        }
+        else
+        {
+            first = last = lower_bound (key);
+        }
+
+        return std::make_pair (first, last);
+    }
+
+    //
+    // Returned reference is valid until the next write to this btree_map.
+    //
+    mapped_type & operator [] (const key_type & key)
+    {
+        return locate (key, [&key] () {
+            return value_type {key, mapped_type {}};
+        })->second;
+    }
+
+    std::pair <iterator, bool> insert (const value_type & value)
+    {
+        auto itr = find (value.first);
+        if (itr != end ())
+        {
+            return std::make_pair (itr, false);
+        }
+
+        locate (value.first, [&value] () { return value; });
+
+        return std::make_pair (find (value.first), true);
+    }
+
+    template <class InputIterator>
+    void insert (InputIterator first, InputIterator last)
+    {
+        for (; first != last; ++ first)
+        {
+            const value_type & value = * first;
+            if (find (value.first) == end ())
+            {
+                locate (value.first, [&value] () { return value; });
+            }
+        }
+    }
+
+    size_type erase (const key_type & key)
+    {
+        if (find (key) == end ())
+        {
+            return 0;
+        }
+
+        erase_below (root_, key);
+        -- size_;
+
+        if (root_->count == 0)
+        {
+            root_.reset ();
+        }
+        else if (! root_->leaf && root_->count == 1)
+        {
+            // root with a single child. The tree gets one level shorter.
+            root_ = node_ptr {as_inner (* root_).children [0]};
+        }
+
+        return 1;
+    }
+
+    void clear () noexcept
+    {
+        root_.reset ();
+        size_ = 0;
+    }
+
+private:
+    //
+    // Separator of a node split off to the right of a child, to be inserted
+    // into the parent of the child.
+    //
+    struct split_result
+    {
+        split_result () = default;
+        split_result (const split_result &) = delete;
+
+        ~split_result ()
+        {
+            if (right)
+            {
+                key ().~key_type ();
+            }
+        }
+
+        key_type & key ()
+        {
+            return * reinterpret_cast <key_type *> (& separator);
+        }
+
+        node_ptr right;
+        storage <key_type> separator;
+    };
+
+    //
+    // Insert at pos of an array of count slots constructed from value.
+    //
+    template <typename T, typename... Args>
+    static void insert_slot (
+        storage <T> * slots,
+        std::size_t count,
+        std::size_t pos,
+        Args && ... args
+    )
+    {
+        T value (std::forward <Args> (args)...);
+        for (auto i = count; i > pos; -- i)
+        {
+            relocate <T> (& slots [i], & slots [i - 1]);
+        }
+        new (& slots [pos]) T (std::move (value));
+    }
+
+    //
+    // Erase at pos of an array of count slots.
+    //
+    template <typename T>
+    static void erase_slot (
+        storage <T> * slots,
+        std::size_t count,
+        std::size_t pos
+    )
+    {
+        reinterpret_cast <T *> (& slots [pos])->~T ();
+        for (auto i = pos; i + 1 < count; ++ i)
+        {
+            relocate <T> (& slots [i], & slots [i + 1]);
+        }
+    }
+
+    template <typename T>
+    static void relocate (storage <T> * to, storage <T> * from)
+    {
+        auto from_value = reinterpret_cast <T *> (from);
+        new (to) T (std::move (* from_value));
+        from_value->~T ();
+    }
+
+    static void insert_child (inner_node & n, std::size_t pos, node_ptr child)
+    {
+        for (auto i = n.count; i > pos; -- i)
+        {
+            n.children [i] = std::move (n.children [i - 1]);
+        }
+        n.children [pos] = std::move (child);
+    }
+
+    static void erase_child (inner_node & n, std::size_t pos)
+    {
+        for (auto i = pos; i + 1 < n.count; ++ i)
+        {
+            n.children [i] = std::move (n.children [i + 1]);
+        }
+        n.children [n.count - 1].reset ();
+    }
+
+    //
+    // index of the child of n whose keys may include key.
+    //
+    std::size_t child_index (const inner_node & n, const key_type & key) const
+    {
+        std::size_t first = 0;
+        std::size_t last = n.count - 1;
+        while (first < last)
+        {
+            auto mid = first + (last - first) / 2;
+            if (compare_ (key, n.key (mid)))
+            {
+                last = mid;
+            }
+            else
+            {
+                first = mid + 1;
+            }
+        }
+
+        return first;
+    }
+
+    //
+    // index of the first element of n not less than key.
+    //
+    std::size_t lower_index (const leaf_node & n, const key_type & key) const
+    {
+        std::size_t first = 0;
+        std::size_t last = n.count;
+        while (first < last)
+        {
+            auto mid = first + (last - first) / 2;
+            if (compare_ (n.entry (mid).first, key))
+            {
+                first = mid + 1;
+            }
+            else
+            {
+                last = mid;
+            }
+        }
+
+        return first;
+    }
+
+    //
+    // index of the first element of n greater than key.
+    //
+    std::size_t upper_index (const leaf_node & n, const key_type & key) const
+    {
+        std::size_t first = 0;
+        std::size_t last = n.count;
+        while (first < last)
+        {
+            auto mid = first + (last - first) / 2;
+            if (compare_ (key, n.entry (mid).first))
+            {
+                last = mid;
+            }
+            else
+            {
+                first = mid + 1;
+            }
+        }
+
+        return first;
+    }
+
+    //
+    // the leaf whose keys may include key.
+    //
+    const leaf_node * descend (const key_type & key) const
+    {
+        auto n = root_.get ();
+        if (! n)
+        {
+            return nullptr;
+        }
+
+        while (! n->leaf)
+        {
+            const auto & inner = as_inner (* n);
+            n = inner.children [child_index (inner, key)].get ();
+        }
+
+        return & as_leaf (* n);
+    }
+
+    const_iterator at_or_next (const leaf_node * leaf, std::size_t pos) const
+    {
+        if (pos < leaf->count)
+        {
+            return const_iterator {this, leaf, pos};
+        }
+
+        return next_leaf (leaf->entry (leaf->count - 1).first);
+    }
+
+    //
+    // the first element of the leaf after the leaf whose last key is key.
+    //
+    const_iterator next_leaf (const key_type & key) const
+    {
+        const node * next = nullptr;
+        for (auto n = root_.get (); ! n->leaf; )
+        {
+            const auto & inner = as_inner (* n);
+            auto i = child_index (inner, key);
+            if (i + 1 < inner.count)
+            {
+                next = inner.children [i + 1].get ();
+            }
+            n = inner.children [i].get ();
+        }
+
+        if (! next)
+        {
+            return end ();
+        }
+
+        while (! next->leaf)
+        {
+            next = as_inner (* next).children [0].get ();
+        }
+
+        return const_iterator {this, & as_leaf (* next), 0};
+    }
+
+    template <typename Node, typename... Args>
+    node_ptr make_node (Args && ... args) const
+    {
+        using node_allocator =
+            typename std::allocator_traits <allocator_type>::
+                template rebind_alloc <Node>;
+
+        return std::allocate_shared <Node> (
+            node_allocator {allocator_}, std::forward <Args> (args)...
+        );
+    }
+
+    //
+    // Fill leaves from the sorted range in order, then make each level of
+    // inner nodes over the level below, until one node, the root, is left.
+    // firsts holds the first key under each node of a level, which is the
+    // separator in front of the node in its parent.
+    //
+    template <class InputIterator>
+    void build_sorted (InputIterator first, InputIterator last)
+    {
+        std::vector <node_ptr> level;
+        std::vector <key_type> firsts;
+
+        const key_type * previous = nullptr;
+        for (; first != last; ++ first)
+        {
+            auto && value = * first;
+            if (previous && ! compare_ (* previous, value.first))
+            {
+                throw std::invalid_argument {
+                    "btree_map: range is not sorted and unique"
+                };
+            }
+
+            if (level.empty () || level.back ()->count == leaf_capacity)
+            {
+                level.push_back (make_node <leaf_node> ());
+                firsts.push_back (value.first);
+            }
+
+            auto & leaf = as_leaf (* level.back ());
+            new (& leaf.slots [leaf.count]) value_type (value);
+            previous = & leaf.entry (leaf.count ++).first;
+            ++ size_;
+        }
+
+        // the last leaf takes elements from the one before it, so that both
+        // are at least half full.
+        if (level.size () > 1 && level.back ()->count < leaf_capacity / 2)
+        {
+            auto & l = as_leaf (* level [level.size () - 2]);
+            auto & r = as_leaf (* level.back ());
+            auto moved = (l.count + r.count) / 2 - r.count;
+            for (auto i = r.count; i > 0; -- i)
+            {
+                relocate <value_type> (
+                    & r.slots [i - 1 + moved],
+                    & r.slots [i - 1]
+                );
+            }
+            for (std::size_t i = 0; i < moved; ++ i)
+            {
+                relocate <value_type> (
+                    & r.slots [i],
+                    & l.slots [l.count - moved + i]
+                );
+            }
+            l.count -= moved;
+            r.count += moved;
+            firsts.back () = r.entry (0).first;
+        }
+
+        while (level.size () > 1)
+        {
+            // the children are spread evenly over the fewest parents.
+            auto parents = (level.size () + inner_capacity - 1) /
+                inner_capacity;
+            std::vector <node_ptr> upper;
+            std::vector <key_type> upper_firsts;
+            std::size_t child = 0;
+            for (std::size_t p = 0; p < parents; ++ p)
+            {
+                auto parent = make_node <inner_node> ();
+                auto & n = as_inner (* parent);
+                upper_firsts.push_back (firsts [child]);
+                n.children [n.count ++] = std::move (level [child ++]);
+
+                auto end = level.size () * (p + 1) / parents;
+                for (; child < end; ++ child)
+                {
+                    new (& n.keys [n.count - 1]) key_type (firsts [child]);
+                    n.children [n.count ++] = std::move (level [child]);
+                }
+
+                upper.push_back (std::move (parent));
+            }
+
+            level.swap (upper);
+            firsts.swap (upper_firsts);
+        }
+
+        if (! level.empty ())
+        {
+            root_ = std::move (level.front ());
+        }
+    }
+
+    //
+    // Make the node in slot exclusively owned by this btree_map, copying it
+    // if it is shared. The caller must have made the parent exclusive.
+    //
+    void make_exclusive (node_ptr & slot) const
+    {
+        if (slot.use_count () == 1)
+        {
+            // pairs with the release by the last other owner when it let go,
+            // so its reads of the node happen before our writes.
+            std::atomic_thread_fence (std::memory_order_acquire);
+            return;
+        }
+
+        if (slot->leaf)
+        {
+            slot = make_node <leaf_node> (as_leaf (* slot));
+        }
+        else
+        {
+            slot = make_node <inner_node> (as_inner (* slot));
+        }
+    }
+
+    //
+    // Find the element of key, copying the path to it. If it does not exist
+    // insert make (). Returns the element, which is in an exclusive leaf.
+    //
+    template <typename Make>
+    value_type * locate (const key_type & key, Make make)
+    {
+        if (! root_)
+        {
+            root_ = make_node <leaf_node> ();
+        }
+
+        split_result split;
+        auto result = insert_below (root_, key, make, split);
+
+        if (split.right)
+        {
+            // root split. The tree gets one level taller.
+            auto root = make_node <inner_node> ();
+            auto & n = as_inner (* root);
+            new (& n.keys [0]) key_type (std::move (split.key ()));
+            n.children [0] = std::move (root_);
+            n.children [1] = split.right;
+            n.count = 2;
+            root_ = std::move (root);
+        }
+
+        return result;
+    }
+
+    template <typename Make>
+    value_type * insert_below (
+        node_ptr & slot,
+        const key_type & key,
+        Make & make,
+        split_result & split
+    )
+    {
+        make_exclusive (slot);
+
+        if (slot->leaf)
+        {
+            auto & leaf = as_leaf (* slot);
+            auto pos = lower_index (leaf, key);
+            if (pos < leaf.count && ! compare_ (key, leaf.entry (pos).first))
+            {
+                return & leaf.entry (pos);
+            }
+
+            insert_slot <value_type> (leaf.slots, leaf.count, pos, make ());
+            ++ leaf.count;
+            ++ size_;
+
+            if (leaf.count <= leaf_capacity)
+            {
+                return & leaf.entry (pos);
+            }
+
+            // split the upper half off to a new right leaf.
+            auto right = make_node <leaf_node> ();
+            auto & r = as_leaf (* right);
+            auto mid = leaf.count / 2;
+            for (auto i = mid; i < leaf.count; ++ i)
+            {
+                relocate <value_type> (
+                    & r.slots [r.count ++],
+                    & leaf.slots [i]
+                );
+            }
+            leaf.count = mid;
+
+            new (& split.separator) key_type (r.entry (0).first);
+            split.right = right;
+
+            return pos < mid ? & leaf.entry (pos) : & r.entry (pos - mid);
+        }
+
+        auto & inner = as_inner (* slot);
+        auto i = child_index (inner, key);
+
+        split_result child_split;
+        auto result = insert_below (inner.children [i], key, make, child_split);
+        if (! child_split.right)
+        {
+            return result;
+        }
+
+        insert_slot <key_type> (
+            inner.keys, inner.count - 1, i, std::move (child_split.key ())
+        );
+        insert_child (inner, i + 1, child_split.right);
+        ++ inner.count;
+
+        if (inner.count <= inner_capacity)
+        {
+            return result;
+        }
+
+        // split the upper half of the children off to a new right node.
+        // The key between the halves moves up to the parent.
+        auto right = make_node <inner_node> ();
+        auto & r = as_inner (* right);
+        auto mid = inner.count / 2;
+        for (auto c = mid; c < inner.count; ++ c)
+        {
+            if (c != mid)
+            {
+                relocate <key_type> (
+                    & r.keys [r.count - 1],
+                    & inner.keys [c - 1]
+                );
+            }
+            r.children [r.count ++] = std::move (inner.children [c]);
+        }
+        relocate <key_type> (& split.separator, & inner.keys [mid - 1]);
+        inner.count = mid;
+        split.right = right;
+
+        return result;
+    }
+
+    //
+    // Erase an existing key below slot, copying the path to it.
+    // A child left with fewer than half its capacity borrows from a sibling
+    // or is merged with it.
+    //
+    void erase_below (node_ptr & slot, const key_type & key)
+    {
+        make_exclusive (slot);
+
+        if (slot->leaf)
+        {
+            auto & leaf = as_leaf (* slot);
+            erase_slot <value_type> (
+                leaf.slots, leaf.count, lower_index (leaf, key)
+            );
+            -- leaf.count;
+            return;
+        }
+
+        auto & inner = as_inner (* slot);
+        auto i = child_index (inner, key);
+        erase_below (inner.children [i], key);
+
+        const auto & child = * inner.children [i];
+        auto minimum = (child.leaf ? leaf_capacity : inner_capacity) / 2;
+        if (child.count < minimum)
+        {
+            rebalance (inner, i, minimum);
+        }
+    }
+
+    void rebalance (inner_node & parent, std::size_t i, std::size_t minimum)
+    {
+        // the sibling to the left, or to the right of the first child.
+        auto left = i > 0 ? i - 1 : i;
+        make_exclusive (parent.children [left]);
+        make_exclusive (parent.children [left + 1]);
+        auto & l = * parent.children [left];
+        auto & r = * parent.children [left + 1];
+
+        if (l.count + r.count < 2 * minimum)
+        {
+            merge (parent, left);
+        }
+        else if (l.count < r.count)
+        {
+            borrow_from_right (parent, left);
+        }
+        else
+        {
+            borrow_from_left (parent, left);
+        }
+    }
+
+    //
+    // Merge child left + 1 of parent into child left.
+    //
+    void merge (inner_node & parent, std::size_t left)
+    {
+        auto & l = * parent.children [left];
+        auto & r = * parent.children [left + 1];
+
+        if (l.leaf)
+        {
+            auto & ll = as_leaf (l);
+            auto & rl = as_leaf (r);
+            for (std::size_t i = 0; i < rl.count; ++ i)
+            {
+                relocate <value_type> (
+                    & ll.slots [ll.count ++],
+                    & rl.slots [i]
+                );
+            }
+            rl.count = 0;
+        }
+        else
+        {
+            auto & li = as_inner (l);
+            auto & ri = as_inner (r);
+            new (& li.keys [li.count - 1]) key_type (parent.key (left));
+            for (std::size_t c = 0; c < ri.count; ++ c)
+            {
+                if (c != 0)
+                {
+                    relocate <key_type> (
+                        & li.keys [li.count - 1],
+                        & ri.keys [c - 1]
+                    );
+                }
+                li.children [li.count ++] = std::move (ri.children [c]);
+            }
+            ri.count = 0;
+        }
+
+        erase_slot <key_type> (parent.keys, parent.count - 1, left);
+        erase_child (parent, left + 1);
+        -- parent.count;
+    }
+
+    //
+    // Move the first element (or child) of child left + 1 to child left.
+    //
+    void borrow_from_right (inner_node & parent, std::size_t left)
+    {
+        auto & l = * parent.children [left];
+        auto & r = * parent.children [left + 1];
+
+        if (l.leaf)
+        {
+            auto & ll = as_leaf (l);
+            auto & rl = as_leaf (r);
+            relocate <value_type> (& ll.slots [ll.count ++], & rl.slots [0]);
+            for (std::size_t i = 1; i < rl.count; ++ i)
+            {
+                relocate <value_type> (& rl.slots [i - 1], & rl.slots [i]);
+            }
+            -- rl.count;
+            replace_key (parent, left, rl.entry (0).first);
+        }
+        else
+        {
+            auto & li = as_inner (l);
+            auto & ri = as_inner (r);
+            new (& li.keys [li.count - 1]) key_type (parent.key (left));
+            li.children [li.count ++] = std::move (ri.children [0]);
+            replace_key (parent, left, ri.key (0));
+            erase_slot <key_type> (ri.keys, ri.count - 1, 0);
+            erase_child (ri, 0);
+            -- ri.count;
+        }
+    }
+
+    //
+    // Move the last element (or child) of child left to child left + 1.
+    //
+    void borrow_from_left (inner_node & parent, std::size_t left)
+    {
+        auto & l = * parent.children [left];
+        auto & r = * parent.children [left + 1];
+
+        if (l.leaf)
+        {
+            auto & ll = as_leaf (l);
+            auto & rl = as_leaf (r);
+            for (auto i = rl.count; i > 0; -- i)
+            {
+                relocate <value_type> (& rl.slots [i], & rl.slots [i - 1]);
+            }
+            relocate <value_type> (& rl.slots [0], & ll.slots [-- ll.count]);
+            ++ rl.count;
+            replace_key (parent, left, rl.entry (0).first);
+        }
+        else
+        {
+            auto & li = as_inner (l);
+            auto & ri = as_inner (r);
+            insert_slot <key_type> (
+                ri.keys,
+                ri.count - 1,
+                0,
+                parent.key (left)
+            );
+            insert_child (ri, 0, std::move (li.children [li.count - 1]));
+            ++ ri.count;
+            -- li.count;
+            replace_key (parent, left, li.key (li.count - 1));
+            li.key (li.count - 1).~key_type ();
+        }
+    }
+
+    static void replace_key (
+        inner_node & n,
+        std::size_t i,
+        const key_type & key
+    )
+    {
+        key_type copy {key};
+        n.key (i).~key_type ();
+        new (& n.keys [i]) key_type (std::move (copy));
+    }
+
+    node_ptr root_;
+    size_type size_ = 0;
+    key_compare compare_;
+    allocator_type allocator_;
+};
+
+//
+// lockfree::map whose writes copy O(log_B n) nodes of a persistent B+ tree
+// instead of the whole map.
+//
+template <
+    typename Key,
+    typename Mapped,
+    typename Compare = std::less <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using persistent_map = map_template <
+    btree_map <Key, Mapped, Compare, Allocator>
+>;
+
+}
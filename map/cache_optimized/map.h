@@ -15,8 +15,9 @@
 #include <memory>
 #include <atomic>
 #include <iostream>
-// You will need to clone the utils repository also.
-#include "../../../utils/allocator/contiguous_stdcontainer_allocator.h"
+
+#include "../../atomic_ptr/atomic_ptr.h"
+#include "../../utils/allocator/contiguous_stdcontainer_allocator.h"
 
 /*
 Notes:
@@ -27,10 +28,12 @@ Notes:
     will require modifiability of the atomic container using the returned
     iterator.
     However members that return const_iterator are provided.
-3.  This map uses the contiguous_allocator from the utils repo to ensure all
-    its elements are contiguously stored in memory. Thus the frequent read
-    operations are cache optimised. The runtime's allocator is used only to
-    initialize the contiguous_allocator in most cases.
+3.  This map uses the contiguous_stdcontainer_allocator in utils/allocator to
+    ensure all its elements are contiguously stored in memory. Thus the
+    frequent read operations are cache optimised. Every clone gets an arena
+    of its own, sized for the elements of the implementation it is cloned
+    from, and the arena is freed in one go with the clone. The runtime's
+    allocator is used only to allocate the arenas.
 */
 
 namespace lockfree
@@ -293,7 +296,10 @@ public:
             {
                 // clone implementation_type by copy construction.
                 desired = std::make_shared <implementation_type> (
-                    * expected
+                    * expected,
+                    allocator_type {
+                        expected->size ()
+                    }
                 );
 
                 count = desired->erase (key);
@@ -542,7 +548,8 @@ private:
     // private data members.
     //
 
-    shared_ptr <implementation_type> implementation_;
+    // lock-free, unlike std::atomic_load etc. of a shared_ptr.
+    atomic_shared_ptr <implementation_type> implementation_;
 };
 
 template <
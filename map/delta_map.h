@@ -0,0 +1,679 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Immutable base map overlaid with a small delta, for use as the
+//      Implementation of lockfree::map_template.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <stdexcept>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+
+#include "map.h"
+
+/*
+Notes:
+1.  delta_map is a map with the interface that map_template needs, made of
+    an immutable base map, shared by all copies, and a small delta of
+    upserted elements and tombstones of erased keys. Copy construction, ie
+    the clone of every lockfree write, copies only the delta.
+2.  A lookup checks the delta first, then the base.
+3.  Once the delta of a write reaches the threshold, the write merges the
+    delta into a new base, in its clone. That is an O(n) write, once every
+    threshold writes.
+4.  The merge can instead be taken off the write path with
+    map_template::compact, on demand or periodically by a delta_compactor
+    thread. compact merges the delta of the current snapshot into a new
+    base before it publishes, and then only rebases the delta of the
+    current snapshot onto the new base, O(delta), when it publishes.
+5.  Iteration visits the base and then the delta, so for an ordered Base it
+    is not in key order.
+6.  Every write invalidates all iterators, pointers and references to
+    elements, like std::vector does.
+*/
+
+namespace lockfree
+{
+
+//
+// Set of keys with the same ordering or hashing as Base.
+//
+template <typename T>
+struct delta_void
+{
+    using type = void;
+};
+
+template <typename Base, typename = void>
+struct delta_key_set
+{
+    using type = std::unordered_set <
+        typename Base::key_type,
+        typename Base::hasher,
+        typename Base::key_equal
+    >;
+};
+
+template <typename Base>
+struct delta_key_set <
+    Base,
+    typename delta_void <typename Base::key_compare>::type
+>
+{
+    using type = std::set <
+        typename Base::key_type,
+        typename Base::key_compare
+    >;
+};
+
+template <typename Base>
+class delta_map : public key_functions <Base>
+{
+public:
+    using base_type = Base;
+    using key_type = typename base_type::key_type;
+    using mapped_type = typename base_type::mapped_type;
+    using value_type = typename base_type::value_type;
+    using size_type = typename base_type::size_type;
+    using difference_type = typename base_type::difference_type;
+    using allocator_type = typename base_type::allocator_type;
+
+    static constexpr size_type default_threshold = 1024;
+
+private:
+    using base_iterator = typename base_type::const_iterator;
+    using key_set = typename delta_key_set <base_type>::type;
+
+public:
+    //
+    // Iterates the elements of the base that are not in the delta, and
+    // then the upserted elements of the delta.
+    //
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename delta_map::value_type;
+        using difference_type = typename delta_map::difference_type;
+        using pointer = typename std::iterator_traits <
+            base_iterator
+        >::pointer;
+        using reference = typename std::iterator_traits <
+            base_iterator
+        >::reference;
+
+        const_iterator () = default;
+
+        reference operator * () const
+        {
+            return in_base () ? * base_ : * upserts_;
+        }
+
+        pointer operator -> () const
+        {
+            return in_base () ? base_.operator -> () : upserts_.operator -> ();
+        }
+
+        const_iterator & operator ++ ()
+        {
+            if (in_base ())
+            {
+                ++ base_;
+                skip_shadowed ();
+            }
+            else
+            {
+                ++ upserts_;
+            }
+            return * this;
+        }
+
+        const_iterator operator ++ (int)
+        {
+            auto itr = * this;
+            ++ (* this);
+            return itr;
+        }
+
+        bool operator == (const const_iterator & other) const
+        {
+            return base_ == other.base_ && upserts_ == other.upserts_;
+        }
+
+        bool operator != (const const_iterator & other) const
+        {
+            return ! (* this == other);
+        }
+
+    private:
+        const_iterator (
+            const delta_map * map,
+            base_iterator base,
+            base_iterator upserts
+        ) : map_ {map}, base_ {base}, upserts_ {upserts}
+        {
+        }
+
+        bool in_base () const
+        {
+            return base_ != map_->base_->cend ();
+        }
+
+        //
+        // Skip elements of the base that the delta has replaced or erased.
+        //
+        void skip_shadowed ()
+        {
+            while (in_base () && map_->shadowed (base_->first))
+            {
+                ++ base_;
+            }
+        }
+
+        const delta_map * map_ = nullptr;
+        base_iterator base_;
+        base_iterator upserts_;
+
+        friend delta_map;
+    };
+
+    // all elements are immutable through an iterator, as in std::set.
+    using iterator = const_iterator;
+
+    explicit delta_map (size_type threshold = default_threshold) :
+        base_ {std::make_shared <const base_type> ()},
+        threshold_ {threshold}
+    {
+    }
+
+    //
+    // Take base as the base.
+    //
+    explicit delta_map (
+        base_type && base,
+        size_type threshold = default_threshold
+    ) :
+        base_ {std::make_shared <const base_type> (std::move (base))},
+        size_ {base_->size ()},
+        threshold_ {threshold}
+    {
+    }
+
+    delta_map (std::initializer_list <value_type> init) :
+        delta_map {base_type {init}}
+    {
+    }
+
+    template <class InputIterator>
+    delta_map (InputIterator first, InputIterator last) :
+        delta_map {base_type {first, last}}
+    {
+    }
+
+    //
+    // Copy construction shares the base and copies the delta.
+    //
+    delta_map (const delta_map & other) = default;
+
+    //
+    // Leaves other empty.
+    //
+    delta_map (delta_map && other) :
+        base_ {std::move (other.base_)},
+        upserts_ {std::move (other.upserts_)},
+        tombstones_ {std::move (other.tombstones_)},
+        size_ {other.size_},
+        threshold_ {other.threshold_}
+    {
+        other.clear ();
+    }
+
+    delta_map & operator = (const delta_map & other) = default;
+
+    delta_map & operator = (delta_map && other)
+    {
+        if (this != & other)
+        {
+            base_ = std::move (other.base_);
+            upserts_ = std::move (other.upserts_);
+            tombstones_ = std::move (other.tombstones_);
+            size_ = other.size_;
+            threshold_ = other.threshold_;
+            other.clear ();
+        }
+
+        return * this;
+    }
+
+    const_iterator begin () const
+    {
+        const_iterator itr {this, base_->cbegin (), upserts_.cbegin ()};
+        itr.skip_shadowed ();
+        return itr;
+    }
+
+    const_iterator end () const
+    {
+        return const_iterator {this, base_->cend (), upserts_.cend ()};
+    }
+
+    const_iterator cbegin () const
+    {
+        return begin ();
+    }
+
+    const_iterator cend () const
+    {
+        return end ();
+    }
+
+    bool empty () const noexcept
+    {
+        return size_ == 0;
+    }
+
+    size_type size () const noexcept
+    {
+        return size_;
+    }
+
+    size_type max_size () const noexcept
+    {
+        return base_->max_size ();
+    }
+
+    allocator_type get_allocator () const noexcept
+    {
+        return base_->get_allocator ();
+    }
+
+    const_iterator find (const key_type & key) const
+    {
+        auto upsert = upserts_.find (key);
+        if (upsert != upserts_.cend ())
+        {
+            return const_iterator {this, base_->cend (), upsert};
+        }
+
+        if (tombstones_.count (key))
+        {
+            return end ();
+        }
+
+        auto base = base_->find (key);
+        if (base == base_->cend ())
+        {
+            return end ();
+        }
+
+        return const_iterator {this, base, upserts_.cbegin ()};
+    }
+
+    size_type count (const key_type & key) const
+    {
+        return find (key) == end () ? 0 : 1;
+    }
+
+    const mapped_type & at (const key_type & key) const
+    {
+        auto itr = find (key);
+        if (itr == end ())
+        {
+            throw std::out_of_range {"delta_map::at"};
+        }
+
+        return itr->second;
+    }
+
+    std::pair <const_iterator, const_iterator>
+    equal_range (const key_type & key) const
+    {
+        auto first = find (key);
+        auto last = first;
+        if (last != end ())
+        {
+            ++ last;
+        }
+
+        return std::make_pair (first, last);
+    }
+
+    //
+    // Returned reference is valid until the next write to this delta_map.
+    //
+    mapped_type & operator [] (const key_type & key)
+    {
+        if (! upserts_.count (key))
+        {
+            // compact before, not after, adding key to the delta, since
+            // compaction would merge away the element referred to.
+            if (delta_size () + 1 >= threshold_)
+            {
+                merge ();
+            }
+
+            auto itr = find (key);
+            if (itr != end ())
+            {
+                stage (value_type {key, itr->second}, true);
+            }
+            else
+            {
+                stage (value_type {key, mapped_type {}}, false);
+            }
+        }
+
+        return upserts_ [key];
+    }
+
+    std::pair <iterator, bool> insert (const value_type & value)
+    {
+        auto itr = find (value.first);
+        if (itr != end ())
+        {
+            return std::make_pair (itr, false);
+        }
+
+        upsert (value, false);
+
+        return std::make_pair (find (value.first), true);
+    }
+
+    template <class InputIterator>
+    void insert (InputIterator first, InputIterator last)
+    {
+        for (; first != last; ++ first)
+        {
+            insert (* first);
+        }
+    }
+
+    size_type erase (const key_type & key)
+    {
+        bool upserted = upserts_.erase (key) != 0;
+        bool in_base = ! tombstones_.count (key) && base_->count (key);
+        if (in_base)
+        {
+            tombstones_.insert (key);
+        }
+
+        if (! upserted && ! in_base)
+        {
+            return 0;
+        }
+
+        -- size_;
+        compact_at_threshold ();
+
+        return 1;
+    }
+
+    void clear ()
+    {
+        base_ = std::make_shared <const base_type> ();
+        upserts_.clear ();
+        tombstones_.clear ();
+        size_ = 0;
+    }
+
+    //
+    // upserted elements plus tombstones.
+    //
+    size_type delta_size () const noexcept
+    {
+        return upserts_.size () + tombstones_.size ();
+    }
+
+    //
+    // Elements and bytes copied by copy construction, for the stats of a
+    // map_template. Only the delta is copied, not the base.
+    //
+    std::pair <size_type, std::size_t> clone_cost () const noexcept
+    {
+        return std::make_pair (
+            delta_size (),
+            upserts_.size () * sizeof (value_type) +
+                tombstones_.size () * sizeof (key_type)
+        );
+    }
+
+    //
+    // Whether a delta_compactor should compact, well before writes reach
+    // the threshold and compact in their clones.
+    //
+    bool needs_compaction () const noexcept
+    {
+        return delta_size () >= threshold_ / 2;
+    }
+
+    //
+    // A copy of this delta_map with its delta merged into a new base.
+    //
+    delta_map compacted () const
+    {
+        delta_map compacted {* this};
+        compacted.merge ();
+        return compacted;
+    }
+
+    //
+    // Given compacted, a compacted copy of from, make compacted the base of
+    // this delta_map, and keep in the delta only the differences from the
+    // new base. O(delta).
+    // Returns false, leaving this delta_map unchanged, if this delta_map is
+    // not based on the same base as from, ie it is compacted already.
+    //
+    bool rebase (const delta_map & from, const delta_map & compacted)
+    {
+        if (base_ != from.base_)
+        {
+            return false;
+        }
+
+        // only keys in either delta can differ between this delta_map and
+        // the new base.
+        base_type upserts;
+        key_set tombstones;
+        const auto & base = * compacted.base_;
+        auto settle = [&] (const key_type & key)
+        {
+            auto itr = find (key);
+            auto in_base = base.find (key);
+            if (itr != end ())
+            {
+                if (
+                    in_base == base.cend () ||
+                    ! (in_base->second == itr->second)
+                )
+                {
+                    upserts.insert (value_type {key, itr->second});
+                }
+            }
+            else if (in_base != base.cend ())
+            {
+                tombstones.insert (key);
+            }
+        };
+
+        for (const auto & upsert : from.upserts_)
+        {
+            settle (upsert.first);
+        }
+        for (const auto & key : from.tombstones_)
+        {
+            settle (key);
+        }
+        for (const auto & upsert : upserts_)
+        {
+            settle (upsert.first);
+        }
+        for (const auto & key : tombstones_)
+        {
+            settle (key);
+        }
+
+        base_ = compacted.base_;
+        upserts_ = std::move (upserts);
+        tombstones_ = std::move (tombstones);
+
+        return true;
+    }
+
+private:
+    //
+    // whether the element of key in the base is replaced or erased.
+    //
+    bool shadowed (const key_type & key) const
+    {
+        return upserts_.count (key) || tombstones_.count (key);
+    }
+
+    //
+    // Put value in the delta. existing is whether its key is in this
+    // delta_map already.
+    //
+    void upsert (const value_type & value, bool existing)
+    {
+        stage (value, existing);
+        compact_at_threshold ();
+    }
+
+    //
+    // upsert without compaction.
+    //
+    void stage (const value_type & value, bool existing)
+    {
+        upserts_.insert (value);
+        tombstones_.erase (value.first);
+        if (! existing)
+        {
+            ++ size_;
+        }
+    }
+
+    void compact_at_threshold ()
+    {
+        if (delta_size () >= threshold_)
+        {
+            merge ();
+        }
+    }
+
+    void merge ()
+    {
+        auto base = std::make_shared <base_type> (* base_);
+        for (const auto & key : tombstones_)
+        {
+            base->erase (key);
+        }
+        for (const auto & upsert : upserts_)
+        {
+            (* base) [upsert.first] = upsert.second;
+        }
+
+        base_ = std::move (base);
+        upserts_.clear ();
+        tombstones_.clear ();
+    }
+
+    std::shared_ptr <const base_type> base_;
+    base_type upserts_;
+    key_set tombstones_;
+    size_type size_ = 0;
+    size_type threshold_;
+};
+
+//
+// Periodically compacts a map_template of a delta_map in a background
+// thread, once the delta of its current snapshot needs compaction.
+//
+template <typename Map>
+class delta_compactor
+{
+public:
+    explicit delta_compactor (
+        Map & map,
+        std::chrono::milliseconds period = std::chrono::milliseconds {10}
+    ) :
+        map_ (map),
+        period_ {period},
+        thread_ {& delta_compactor::run, this}
+    {
+    }
+
+    delta_compactor (const delta_compactor &) = delete;
+    delta_compactor & operator = (const delta_compactor &) = delete;
+
+    ~delta_compactor ()
+    {
+        {
+            std::lock_guard <std::mutex> lock {mutex_};
+            stop_ = true;
+        }
+        stopped_.notify_one ();
+        thread_.join ();
+    }
+
+private:
+    void run ()
+    {
+        std::unique_lock <std::mutex> lock {mutex_};
+        while (! stopped_.wait_for (lock, period_, [this] { return stop_; }))
+        {
+            lock.unlock ();
+            if (map_.snapshot ().implementation ().needs_compaction ())
+            {
+                map_.compact ();
+            }
+            lock.lock ();
+        }
+    }
+
+    Map & map_;
+    std::chrono::milliseconds period_;
+    std::mutex mutex_;
+    std::condition_variable stopped_;
+    bool stop_ = false;
+
+    // last, so that it starts once all other members are constructed.
+    std::thread thread_;
+};
+
+template <
+    typename Key,
+    typename Mapped,
+    typename Predicate = std::less <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using overlay_map = map_template <
+    delta_map <std::map <Key, Mapped, Predicate, Allocator>>
+>;
+
+template <
+    typename Key,
+    typename Mapped,
+    typename Hash = std::hash <Key>,
+    typename Predicate = std::equal_to <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using overlay_unordered_map = map_template <
+    delta_map <std::unordered_map <Key, Mapped, Hash, Predicate, Allocator>>
+>;
+
+}
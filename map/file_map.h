@@ -0,0 +1,1055 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Sorted array map that is saved to a file and opened from it with
+//      mmap, for use as the Implementation of lockfree::map_template.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined (__unix__) || defined (__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#define LOCKFREE_FILE_MAP_MMAP
+#endif
+
+#include "map.h"
+
+/*
+Notes:
+1.  file_map is an ordered map with the interface of std::map that
+    map_template needs, for trivially copyable keys and mapped values. Like
+    flat_map, it keeps its keys sorted in one array and its mapped values
+    in another, at the same positions.
+2.  file_map::save writes a snapshot of a map to a file: a header, then the
+    key array, then the mapped array, each at an offset from the start of
+    the file. Nothing in the file is an address, so it can be mapped
+    anywhere.
+3.  file_map::open maps such a file read-only with mmap, and uses its
+    arrays in place. Nothing is parsed or copied; the OS reads pages in as
+    lookups first touch them. A process restart is a warm start.
+4.  The arrays are never changed once shared, so copy construction, ie the
+    clone of every lockfree write, only shares them. The first write to a
+    copy copies both arrays to the heap, and changes the copy alone. Later
+    writes to the same copy, eg the rest of a transaction, are in place.
+    The file itself is never written through a file_map.
+5.  save writes a new file, under a name unique to the process and thread,
+    and renames it over path. So a file_map opened from path earlier keeps
+    its pages, no reader of path sees a half written file, and concurrent
+    saves to one path do not clash: the last rename wins. With POSIX, save
+    also flushes the new file to the disk before the rename, and the
+    directory after it, so that after a crash path holds either the old or
+    the new contents. Without POSIX, nothing is flushed.
+6.  The header records the size and alignment of the key and the mapped,
+    and the byte order. open throws std::runtime_error for a file that was
+    written by a build whose types or platform differ, or whose arrays do
+    not fit in it. The order of the keys is not checked: open does not
+    read the arrays.
+7.  Without mmap, ie on a platform that is not POSIX, open reads the file
+    into the heap instead.
+*/
+
+namespace lockfree
+{
+
+template <
+    typename Key,
+    typename Mapped,
+    typename Compare = std::less <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+class file_map
+{
+    static_assert (
+        std::is_trivially_copyable <Key>::value &&
+        std::is_trivially_copyable <Mapped>::value,
+        "file_map keys and mapped values must be trivially copyable"
+    );
+
+public:
+    using key_type = Key;
+    using mapped_type = Mapped;
+    using value_type = std::pair <const Key, Mapped>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using key_compare = Compare;
+    using allocator_type = Allocator;
+    using reference = std::pair <const key_type &, const mapped_type &>;
+    using const_reference = reference;
+
+private:
+    using key_allocator = typename std::allocator_traits <
+        allocator_type
+    >::template rebind_alloc <key_type>;
+    using mapped_allocator = typename std::allocator_traits <
+        allocator_type
+    >::template rebind_alloc <mapped_type>;
+
+    //
+    // The arrays of a file_map that has been written.
+    //
+    struct arrays
+    {
+        explicit arrays (const allocator_type & allocator) :
+            keys {key_allocator {allocator}},
+            mapped {mapped_allocator {allocator}}
+        {
+        }
+
+        std::vector <key_type, key_allocator> keys;
+        std::vector <mapped_type, mapped_allocator> mapped;
+    };
+
+    //
+    // Start of a file. All offsets are from the start of the file.
+    //
+    struct file_header
+    {
+        char magic [8];
+        std::uint32_t version;
+        std::uint32_t byte_order;
+        std::uint32_t key_size;
+        std::uint32_t key_alignment;
+        std::uint32_t mapped_size;
+        std::uint32_t mapped_alignment;
+        std::uint64_t count;
+        std::uint64_t keys_offset;
+        std::uint64_t mapped_offset;
+    };
+
+    static constexpr std::uint32_t file_version = 1;
+    static constexpr std::uint32_t byte_order_mark = 0x01020304;
+
+    // arrays start on a cache line.
+    static constexpr std::uint64_t array_alignment = 64;
+
+public:
+    //
+    // Dereferences to a pair of references to a key and its mapped, like
+    // the iterator of flat_map.
+    //
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = typename file_map::value_type;
+        using difference_type = typename file_map::difference_type;
+        using reference = typename file_map::reference;
+
+        //
+        // operator -> returns this proxy, which holds the pair of
+        // references that operator * returns.
+        //
+        class pointer
+        {
+        public:
+            const reference * operator -> () const
+            {
+                return & reference_;
+            }
+
+        private:
+            explicit pointer (reference r) : reference_ {r}
+            {
+            }
+
+            reference reference_;
+
+            friend const_iterator;
+        };
+
+        const_iterator () = default;
+
+        reference operator * () const
+        {
+            return reference {* key_, * mapped_};
+        }
+
+        pointer operator -> () const
+        {
+            return pointer {* (* this)};
+        }
+
+        reference operator [] (difference_type n) const
+        {
+            return * (* this + n);
+        }
+
+        const_iterator & operator ++ ()
+        {
+            ++ key_;
+            ++ mapped_;
+            return * this;
+        }
+
+        const_iterator operator ++ (int)
+        {
+            auto itr = * this;
+            ++ (* this);
+            return itr;
+        }
+
+        const_iterator & operator -- ()
+        {
+            -- key_;
+            -- mapped_;
+            return * this;
+        }
+
+        const_iterator operator -- (int)
+        {
+            auto itr = * this;
+            -- (* this);
+            return itr;
+        }
+
+        const_iterator & operator += (difference_type n)
+        {
+            key_ += n;
+            mapped_ += n;
+            return * this;
+        }
+
+        const_iterator & operator -= (difference_type n)
+        {
+            return * this += -n;
+        }
+
+        const_iterator operator + (difference_type n) const
+        {
+            auto itr = * this;
+            return itr += n;
+        }
+
+        const_iterator operator - (difference_type n) const
+        {
+            auto itr = * this;
+            return itr -= n;
+        }
+
+        difference_type operator - (const const_iterator & other) const
+        {
+            return key_ - other.key_;
+        }
+
+        bool operator == (const const_iterator & other) const
+        {
+            return key_ == other.key_;
+        }
+
+        bool operator != (const const_iterator & other) const
+        {
+            return ! (* this == other);
+        }
+
+        bool operator < (const const_iterator & other) const
+        {
+            return key_ < other.key_;
+        }
+
+        bool operator > (const const_iterator & other) const
+        {
+            return other < * this;
+        }
+
+        bool operator <= (const const_iterator & other) const
+        {
+            return ! (other < * this);
+        }
+
+        bool operator >= (const const_iterator & other) const
+        {
+            return ! (* this < other);
+        }
+
+    private:
+        const_iterator (const key_type * key, const mapped_type * mapped) :
+            key_ {key}, mapped_ {mapped}
+        {
+        }
+
+        const key_type * key_ = nullptr;
+        const mapped_type * mapped_ = nullptr;
+
+        friend file_map;
+    };
+
+    // all elements are immutable through an iterator, as in std::set.
+    using iterator = const_iterator;
+
+    file_map () = default;
+
+    explicit file_map (
+        const key_compare & compare,
+        const allocator_type & allocator = allocator_type {}
+    ) : compare_ {compare}, allocator_ {allocator}
+    {
+    }
+
+    explicit file_map (const allocator_type & allocator) :
+        allocator_ {allocator}
+    {
+    }
+
+    file_map (
+        std::initializer_list <value_type> init,
+        const key_compare & compare = key_compare {},
+        const allocator_type & allocator = allocator_type {}
+    ) : file_map {compare, allocator}
+    {
+        insert (init.begin (), init.end ());
+    }
+
+    template <class InputIterator>
+    file_map (
+        InputIterator first,
+        InputIterator last,
+        const key_compare & compare = key_compare {},
+        const allocator_type & allocator = allocator_type {}
+    ) : file_map {compare, allocator}
+    {
+        insert (first, last);
+    }
+
+    //
+    // From a range sorted by key, with no two equal keys, in O(n).
+    // Throws std::invalid_argument if the range is not sorted and unique.
+    //
+    template <class InputIterator>
+    file_map (
+        sorted_unique_t,
+        InputIterator first,
+        InputIterator last,
+        const key_compare & compare = key_compare {},
+        const allocator_type & allocator = allocator_type {}
+    ) : file_map {compare, allocator}
+    {
+        auto & a = writable ();
+        for (; first != last; ++ first)
+        {
+            auto && value = * first;
+            if (! a.keys.empty () && ! compare_ (a.keys.back (), value.first))
+            {
+                throw std::invalid_argument {
+                    "file_map: range is not sorted and unique"
+                };
+            }
+
+            a.keys.push_back (value.first);
+            a.mapped.push_back (value.second);
+        }
+        refresh ();
+    }
+
+    //
+    // Copy construction shares the arrays of other. O(1).
+    //
+    file_map (const file_map & other) = default;
+
+    file_map (file_map && other) noexcept :
+        keys_ {other.keys_},
+        mapped_ {other.mapped_},
+        size_ {other.size_},
+        storage_ {std::move (other.storage_)},
+        heap_ {other.heap_},
+        compare_ {std::move (other.compare_)},
+        allocator_ {other.allocator_}
+    {
+        other.forget ();
+    }
+
+    file_map & operator = (const file_map & other) = default;
+
+    file_map & operator = (file_map && other) noexcept
+    {
+        if (this != & other)
+        {
+            keys_ = other.keys_;
+            mapped_ = other.mapped_;
+            size_ = other.size_;
+            storage_ = std::move (other.storage_);
+            heap_ = other.heap_;
+            compare_ = std::move (other.compare_);
+            allocator_ = other.allocator_;
+            other.forget ();
+        }
+
+        return * this;
+    }
+
+    //
+    // Write the elements of one snapshot of map, a lockfree map with the
+    // same key and mapped types, to the file at path. See Notes 2 and 5.
+    // Throws std::runtime_error if the file cannot be written, or
+    // std::system_error if it cannot be flushed.
+    //
+    template <typename Map>
+    static void save (const Map & map, const std::string & path)
+    {
+        auto view = map.snapshot ();
+
+        std::vector <std::pair <key_type, mapped_type>> elements (
+            view.begin (), view.end ()
+        );
+        key_compare compare;
+        auto by_key = [&compare] (
+            const std::pair <key_type, mapped_type> & a,
+            const std::pair <key_type, mapped_type> & b
+        )
+        {
+            return compare (a.first, b.first);
+        };
+        if (! std::is_sorted (elements.begin (), elements.end (), by_key))
+        {
+            std::sort (elements.begin (), elements.end (), by_key);
+        }
+
+        file_header header {};
+        std::memcpy (header.magic, magic (), sizeof (header.magic));
+        header.version = file_version;
+        header.byte_order = byte_order_mark;
+        header.key_size = sizeof (key_type);
+        header.key_alignment = alignof (key_type);
+        header.mapped_size = sizeof (mapped_type);
+        header.mapped_alignment = alignof (mapped_type);
+        header.count = elements.size ();
+        header.keys_offset = aligned (sizeof (file_header));
+        header.mapped_offset = aligned (
+            header.keys_offset + header.count * sizeof (key_type)
+        );
+
+        auto temporary = temporary_path (path);
+        {
+            std::ofstream out {temporary, std::ios::binary | std::ios::trunc};
+
+            write (out, & header, sizeof (header));
+            pad (out, header.keys_offset - sizeof (header));
+            for (const auto & element : elements)
+            {
+                write (out, & element.first, sizeof (key_type));
+            }
+            pad (
+                out,
+                header.mapped_offset - header.keys_offset -
+                    header.count * sizeof (key_type)
+            );
+            for (const auto & element : elements)
+            {
+                write (out, & element.second, sizeof (mapped_type));
+            }
+
+            out.close ();
+            if (! out)
+            {
+                std::remove (temporary.c_str ());
+                throw std::runtime_error {"file_map: cannot write " + path};
+            }
+        }
+
+        try
+        {
+            sync (temporary);
+        }
+        catch (...)
+        {
+            std::remove (temporary.c_str ());
+            throw;
+        }
+
+        if (std::rename (temporary.c_str (), path.c_str ()) != 0)
+        {
+            std::remove (temporary.c_str ());
+            throw std::runtime_error {"file_map: cannot write " + path};
+        }
+
+        // the rename is durable once the directory entry is.
+        auto slash = path.find_last_of ('/');
+        sync (
+            slash == std::string::npos ? std::string {"."} :
+                path.substr (0, slash == 0 ? 1 : slash)
+        );
+    }
+
+    //
+    // A file_map of the file at path, written by save. See Notes 3 and 6.
+    // Throws std::system_error if the file cannot be opened or mapped.
+    //
+    static file_map open (
+        const std::string & path,
+        const key_compare & compare = key_compare {},
+        const allocator_type & allocator = allocator_type {}
+    )
+    {
+        std::size_t length = 0;
+        auto mapping = map_file (path, length);
+
+        auto first = static_cast <const char *> (mapping.get ());
+        file_header header;
+        if (length < sizeof (header))
+        {
+            throw std::runtime_error {"file_map: not a map file " + path};
+        }
+        std::memcpy (& header, first, sizeof (header));
+        check (header, length, path);
+
+        file_map m {compare, allocator};
+        m.keys_ = reinterpret_cast <const key_type *> (
+            first + header.keys_offset
+        );
+        m.mapped_ = reinterpret_cast <const mapped_type *> (
+            first + header.mapped_offset
+        );
+        m.size_ = static_cast <size_type> (header.count);
+        m.storage_ = std::move (mapping);
+
+        return m;
+    }
+
+    //
+    // Whether the arrays are still those of the file this was opened from.
+    //
+    bool is_mapped () const noexcept
+    {
+        return storage_ && ! heap_;
+    }
+
+    const_iterator begin () const noexcept
+    {
+        return const_iterator {keys_, mapped_};
+    }
+
+    const_iterator end () const noexcept
+    {
+        return begin () + size ();
+    }
+
+    const_iterator cbegin () const noexcept
+    {
+        return begin ();
+    }
+
+    const_iterator cend () const noexcept
+    {
+        return end ();
+    }
+
+    bool empty () const noexcept
+    {
+        return size_ == 0;
+    }
+
+    size_type size () const noexcept
+    {
+        return size_;
+    }
+
+    //
+    // Elements and bytes copied by copy construction, for the stats of a
+    // map_template. None, since copies share the arrays.
+    //
+    std::pair <size_type, std::size_t> clone_cost () const noexcept
+    {
+        return std::make_pair (size_type {0}, std::size_t {0});
+    }
+
+    size_type max_size () const noexcept
+    {
+        return std::numeric_limits <difference_type>::max () /
+            (sizeof (key_type) + sizeof (mapped_type));
+    }
+
+    allocator_type get_allocator () const noexcept
+    {
+        return allocator_;
+    }
+
+    key_compare key_comp () const
+    {
+        return compare_;
+    }
+
+    const_iterator find (const key_type & key) const
+    {
+        auto pos = lower_index (key);
+        if (pos < size () && ! compare_ (key, keys_ [pos]))
+        {
+            return begin () + pos;
+        }
+
+        return end ();
+    }
+
+    size_type count (const key_type & key) const
+    {
+        return find (key) == end () ? 0 : 1;
+    }
+
+    const mapped_type & at (const key_type & key) const
+    {
+        auto itr = find (key);
+        if (itr == end ())
+        {
+            throw std::out_of_range {"file_map::at"};
+        }
+
+        return * itr.mapped_;
+    }
+
+    //
+    // first element whose key is not less than key.
+    //
+    const_iterator lower_bound (const key_type & key) const
+    {
+        return begin () + lower_index (key);
+    }
+
+    //
+    // first element whose key is greater than key.
+    //
+    const_iterator upper_bound (const key_type & key) const
+    {
+        auto pos = lower_index (key);
+        if (pos < size () && ! compare_ (key, keys_ [pos]))
+        {
+            ++ pos;
+        }
+
+        return begin () + pos;
+    }
+
+    std::pair <const_iterator, const_iterator>
+    equal_range (const key_type & key) const
+    {
+        auto first = lower_bound (key);
+        auto last = first;
+        if (last != end () && ! compare_ (key, * last.key_))
+        {
+            ++ last;
+        }
+
+        return std::make_pair (first, last);
+    }
+
+    //
+    // Returned reference is valid until the next write to this file_map.
+    //
+    mapped_type & operator [] (const key_type & key)
+    {
+        auto pos = lower_index (key);
+        auto & a = writable ();
+        if (pos == size () || compare_ (key, keys_ [pos]))
+        {
+            insert_at (a, pos, key, mapped_type {});
+        }
+
+        return a.mapped [pos];
+    }
+
+    std::pair <iterator, bool> insert (const value_type & value)
+    {
+        auto pos = lower_index (value.first);
+        if (pos < size () && ! compare_ (value.first, keys_ [pos]))
+        {
+            return std::make_pair (begin () + pos, false);
+        }
+
+        insert_at (writable (), pos, value.first, value.second);
+
+        return std::make_pair (begin () + pos, true);
+    }
+
+    template <class InputIterator>
+    void insert (InputIterator first, InputIterator last)
+    {
+        for (; first != last; ++ first)
+        {
+            insert (* first);
+        }
+    }
+
+    size_type erase (const key_type & key)
+    {
+        auto pos = lower_index (key);
+        if (pos == size () || compare_ (key, keys_ [pos]))
+        {
+            return 0;
+        }
+
+        auto & a = writable ();
+        a.keys.erase (a.keys.begin () + pos);
+        a.mapped.erase (a.mapped.begin () + pos);
+        refresh ();
+
+        return 1;
+    }
+
+    void clear () noexcept
+    {
+        forget ();
+    }
+
+private:
+    static const char * magic () noexcept
+    {
+        return "lfmap\0\0";
+    }
+
+    static std::uint64_t aligned (std::uint64_t offset) noexcept
+    {
+        return (offset + array_alignment - 1) & ~ (array_alignment - 1);
+    }
+
+    static void write (std::ofstream & out, const void * data, std::size_t n)
+    {
+        out.write (static_cast <const char *> (data), n);
+    }
+
+    static void pad (std::ofstream & out, std::uint64_t n)
+    {
+        static const char zeros [array_alignment] = {};
+        write (out, zeros, static_cast <std::size_t> (n));
+    }
+
+    //
+    // The name of the file save writes before it renames it to path.
+    // Unique to the process and the thread, so that concurrent saves do not
+    // write the same file.
+    //
+    static std::string temporary_path (const std::string & path)
+    {
+#if defined (LOCKFREE_FILE_MAP_MMAP)
+        auto process = static_cast <unsigned long long> (::getpid ());
+#else
+        auto process = static_cast <unsigned long long> (
+            std::chrono::steady_clock::now ().time_since_epoch ().count ()
+        );
+#endif
+        auto thread = std::hash <std::thread::id> {} (
+            std::this_thread::get_id ()
+        );
+
+        return path + ".tmp." + std::to_string (process) + "." +
+            std::to_string (thread);
+    }
+
+    //
+    // Flush the file or directory at path to the disk. Without POSIX, does
+    // nothing.
+    //
+    static void sync (const std::string & path)
+    {
+#if defined (LOCKFREE_FILE_MAP_MMAP)
+        int fd = ::open (path.c_str (), O_RDONLY);
+        if (fd < 0 || ::fsync (fd) != 0)
+        {
+            auto error = errno;
+            if (fd >= 0)
+            {
+                ::close (fd);
+            }
+            throw std::system_error {
+                error, std::generic_category (), "file_map: fsync " + path
+            };
+        }
+        ::close (fd);
+#else
+        (void) path;
+#endif
+    }
+
+    //
+    // Throws unless the file of header, length bytes long, holds arrays of
+    // key_type and mapped_type that fit in it.
+    //
+    static void check (
+        const file_header & header,
+        std::size_t length,
+        const std::string & path
+    )
+    {
+        auto fits = [&] (std::uint64_t offset, std::size_t size) {
+            return offset <= length &&
+                header.count <= (length - offset) / size;
+        };
+
+        if (
+            std::memcmp (header.magic, magic (), sizeof (header.magic)) != 0 ||
+            header.version != file_version ||
+            header.byte_order != byte_order_mark
+        )
+        {
+            throw std::runtime_error {"file_map: not a map file " + path};
+        }
+
+        if (
+            header.key_size != sizeof (key_type) ||
+            header.key_alignment != alignof (key_type) ||
+            header.mapped_size != sizeof (mapped_type) ||
+            header.mapped_alignment != alignof (mapped_type)
+        )
+        {
+            throw std::runtime_error {
+                "file_map: key or mapped type differs in " + path
+            };
+        }
+
+        if (
+            header.keys_offset % alignof (key_type) != 0 ||
+            header.mapped_offset % alignof (mapped_type) != 0 ||
+            ! fits (header.keys_offset, sizeof (key_type)) ||
+            ! fits (header.mapped_offset, sizeof (mapped_type))
+        )
+        {
+            throw std::runtime_error {"file_map: truncated " + path};
+        }
+    }
+
+    //
+    // The whole file at path, read-only, and its length.
+    //
+    static std::shared_ptr <const void> map_file (
+        const std::string & path,
+        std::size_t & length
+    )
+    {
+#if defined (LOCKFREE_FILE_MAP_MMAP)
+        int fd = ::open (path.c_str (), O_RDONLY);
+        if (fd < 0)
+        {
+            throw std::system_error {
+                errno, std::generic_category (), "file_map: open " + path
+            };
+        }
+
+        struct stat status;
+        if (::fstat (fd, & status) != 0)
+        {
+            auto error = errno;
+            ::close (fd);
+            throw std::system_error {
+                error, std::generic_category (), "file_map: stat " + path
+            };
+        }
+        length = static_cast <std::size_t> (status.st_size);
+
+        // an empty file cannot be mapped, and is not a map file anyway.
+        if (length == 0)
+        {
+            ::close (fd);
+            return std::shared_ptr <const void> {};
+        }
+
+        void * address = ::mmap (nullptr, length, PROT_READ, MAP_SHARED, fd, 0);
+        auto error = errno;
+        ::close (fd);
+        if (address == MAP_FAILED)
+        {
+            throw std::system_error {
+                error, std::generic_category (), "file_map: mmap " + path
+            };
+        }
+
+        return std::shared_ptr <const void> {
+            address,
+            [length] (void * p) { ::munmap (p, length); }
+        };
+#else
+        std::ifstream in {path, std::ios::binary | std::ios::ate};
+        if (! in)
+        {
+            throw std::system_error {
+                ENOENT, std::generic_category (), "file_map: open " + path
+            };
+        }
+        length = static_cast <std::size_t> (in.tellg ());
+        in.seekg (0);
+
+        // operator new memory is aligned for any key and mapped.
+        std::shared_ptr <char> contents {
+            static_cast <char *> (::operator new (length + 1)),
+            [] (char * p) { ::operator delete (p); }
+        };
+        in.read (contents.get (), length);
+        if (! in)
+        {
+            throw std::runtime_error {"file_map: cannot read " + path};
+        }
+
+        return contents;
+#endif
+    }
+
+    //
+    // The arrays on the heap, exclusively owned by this file_map. Copies
+    // them there first if they are in a file, or shared with a copy.
+    //
+    arrays & writable ()
+    {
+        if (heap_ && storage_.use_count () == 1)
+        {
+            // pairs with the release by the last other owner when it let go,
+            // so its reads of the arrays happen before our writes.
+            std::atomic_thread_fence (std::memory_order_acquire);
+            return * heap_;
+        }
+
+        using arrays_allocator = typename std::allocator_traits <
+            allocator_type
+        >::template rebind_alloc <arrays>;
+
+        auto copy = std::allocate_shared <arrays> (
+            arrays_allocator {allocator_}, allocator_
+        );
+        copy->keys.assign (keys_, keys_ + size_);
+        copy->mapped.assign (mapped_, mapped_ + size_);
+
+        heap_ = copy.get ();
+        storage_ = std::move (copy);
+        refresh ();
+
+        return * heap_;
+    }
+
+    //
+    // Point the arrays at heap_ again after a write to it.
+    //
+    void refresh () noexcept
+    {
+        keys_ = heap_->keys.data ();
+        mapped_ = heap_->mapped.data ();
+        size_ = heap_->keys.size ();
+    }
+
+    void forget () noexcept
+    {
+        keys_ = nullptr;
+        mapped_ = nullptr;
+        size_ = 0;
+        storage_.reset ();
+        heap_ = nullptr;
+    }
+
+    //
+    // Insert key and mapped at pos of a, keeping both arrays the same size
+    // if either insert throws.
+    //
+    template <typename M>
+    void insert_at (
+        arrays & a,
+        size_type pos,
+        const key_type & key,
+        M && mapped
+    )
+    {
+        a.keys.insert (a.keys.begin () + pos, key);
+        try
+        {
+            a.mapped.insert (
+                a.mapped.begin () + pos, std::forward <M> (mapped)
+            );
+        }
+        catch (...)
+        {
+            a.keys.erase (a.keys.begin () + pos);
+            refresh ();
+            throw;
+        }
+        refresh ();
+    }
+
+    static void prefetch (const void * address)
+    {
+#if defined (__GNUC__)
+        __builtin_prefetch (address);
+#else
+        (void) address;
+#endif
+    }
+
+    //
+    // index of the first key not less than key, by the branch free binary
+    // search of flat_map.
+    //
+    size_type lower_index (const key_type & key) const
+    {
+        auto length = size ();
+        if (length == 0)
+        {
+            return 0;
+        }
+
+        const key_type * base = keys_;
+        while (length > 1)
+        {
+            auto half = length / 2;
+            prefetch (base + half / 2);
+            prefetch (base + half + half / 2);
+            base = compare_ (base [half], key) ? base + half : base;
+            length -= half;
+        }
+
+        return (base - keys_) + (compare_ (* base, key) ? 1 : 0);
+    }
+
+    // the arrays, in a mapped file or in heap_.
+    const key_type * keys_ = nullptr;
+    const mapped_type * mapped_ = nullptr;
+    size_type size_ = 0;
+
+    // owns the arrays: the mapping of a file, or heap_.
+    std::shared_ptr <const void> storage_;
+
+    // the arrays on the heap, once written. Shared with copies until one of
+    // them writes again.
+    arrays * heap_ = nullptr;
+
+    key_compare compare_;
+    allocator_type allocator_;
+};
+
+//
+// lockfree::map that starts from a file saved by file_map::save, eg
+//      lockfree::file_map <int, int>::save (m, "m.map");
+//      ...
+//      lockfree::mapped_file_map <int, int> m {
+//          lockfree::file_map <int, int>::open ("m.map")
+//      };
+//
+template <
+    typename Key,
+    typename Mapped,
+    typename Compare = std::less <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using mapped_file_map = map_template <
+    file_map <Key, Mapped, Compare, Allocator>
+>;
+
+}
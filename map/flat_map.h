@@ -0,0 +1,573 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Sorted contiguous array map for use as the Implementation of
+//      lockfree::map_template.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "map.h"
+
+/*
+Notes:
+1.  flat_map is an ordered map with the interface of std::map that
+    map_template needs. It keeps its keys sorted in one array and its
+    mapped values in another, at the same positions. The published
+    implementation of a map_template is never changed, so flat_map is meant
+    for maps that are read far more often than written.
+2.  A lookup is a binary search over the key array alone, without the
+    pointer chasing of a node based map. The search is branch free, ie the
+    next probe is selected with a conditional move rather than a branch, and
+    it prefetches both candidates of the next but one probe.
+3.  Copy construction, ie the clone of every lockfree write, is a copy of
+    two arrays with no per element allocation. For trivially copyable keys
+    and mapped values that is two memcpys.
+4.  A write shifts the elements after it. Like the clone before it, that is
+    O(n).
+5.  Since keys and mapped values are stored apart, an iterator does not
+    point to a value_type. It dereferences to a pair of references to the
+    key and the mapped, as in std::flat_map of C++23.
+6.  Every write invalidates all iterators, pointers and references to
+    elements, like std::vector does.
+7.  The arrays are std::vectors, and std::vector <bool> packs bits rather
+    than storing bools. So neither keys nor mapped values may be bool.
+    Use eg char, or an enum with an underlying type of one byte, instead.
+*/
+
+namespace lockfree
+{
+
+template <
+    typename Key,
+    typename Mapped,
+    typename Compare = std::less <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+class flat_map
+{
+    static_assert (
+        ! std::is_same <Key, bool>::value &&
+        ! std::is_same <Mapped, bool>::value,
+        "flat_map keys and mapped values must not be bool. See Note 7."
+    );
+
+public:
+    using key_type = Key;
+    using mapped_type = Mapped;
+    using value_type = std::pair <const Key, Mapped>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using key_compare = Compare;
+    using allocator_type = Allocator;
+    using reference = std::pair <const key_type &, const mapped_type &>;
+    using const_reference = reference;
+
+private:
+    using key_allocator = typename std::allocator_traits <
+        allocator_type
+    >::template rebind_alloc <key_type>;
+    using mapped_allocator = typename std::allocator_traits <
+        allocator_type
+    >::template rebind_alloc <mapped_type>;
+
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::random_access_iterator_tag;
+        using value_type = typename flat_map::value_type;
+        using difference_type = typename flat_map::difference_type;
+        using reference = typename flat_map::reference;
+
+        //
+        // operator -> returns this proxy, which holds the pair of
+        // references that operator * returns.
+        //
+        class pointer
+        {
+        public:
+            const reference * operator -> () const
+            {
+                return & reference_;
+            }
+
+        private:
+            explicit pointer (reference r) : reference_ {r}
+            {
+            }
+
+            reference reference_;
+
+            friend const_iterator;
+        };
+
+        const_iterator () = default;
+
+        reference operator * () const
+        {
+            return reference {* key_, * mapped_};
+        }
+
+        pointer operator -> () const
+        {
+            return pointer {* (* this)};
+        }
+
+        reference operator [] (difference_type n) const
+        {
+            return * (* this + n);
+        }
+
+        const_iterator & operator ++ ()
+        {
+            ++ key_;
+            ++ mapped_;
+            return * this;
+        }
+
+        const_iterator operator ++ (int)
+        {
+            auto itr = * this;
+            ++ (* this);
+            return itr;
+        }
+
+        const_iterator & operator -- ()
+        {
+            -- key_;
+            -- mapped_;
+            return * this;
+        }
+
+        const_iterator operator -- (int)
+        {
+            auto itr = * this;
+            -- (* this);
+            return itr;
+        }
+
+        const_iterator & operator += (difference_type n)
+        {
+            key_ += n;
+            mapped_ += n;
+            return * this;
+        }
+
+        const_iterator & operator -= (difference_type n)
+        {
+            return * this += -n;
+        }
+
+        const_iterator operator + (difference_type n) const
+        {
+            auto itr = * this;
+            return itr += n;
+        }
+
+        const_iterator operator - (difference_type n) const
+        {
+            auto itr = * this;
+            return itr -= n;
+        }
+
+        difference_type operator - (const const_iterator & other) const
+        {
+            return key_ - other.key_;
+        }
+
+        bool operator == (const const_iterator & other) const
+        {
+            return key_ == other.key_;
+        }
+
+        bool operator != (const const_iterator & other) const
+        {
+            return ! (* this == other);
+        }
+
+        bool operator < (const const_iterator & other) const
+        {
+            return key_ < other.key_;
+        }
+
+        bool operator > (const const_iterator & other) const
+        {
+            return other < * this;
+        }
+
+        bool operator <= (const const_iterator & other) const
+        {
+            return ! (other < * this);
+        }
+
+        bool operator >= (const const_iterator & other) const
+        {
+            return ! (* this < other);
+        }
+
+    private:
+        const_iterator (const key_type * key, const mapped_type * mapped) :
+            key_ {key}, mapped_ {mapped}
+        {
+        }
+
+        const key_type * key_ = nullptr;
+        const mapped_type * mapped_ = nullptr;
+
+        friend flat_map;
+    };
+
+    // all elements are immutable through an iterator, as in std::set.
+    using iterator = const_iterator;
+
+    flat_map () = default;
+
+    explicit flat_map (
+        const key_compare & compare,
+        const allocator_type & allocator = allocator_type {}
+    ) :
+        keys_ {key_allocator {allocator}},
+        mapped_ {mapped_allocator {allocator}},
+        compare_ {compare}
+    {
+    }
+
+    explicit flat_map (const allocator_type & allocator) :
+        keys_ {key_allocator {allocator}},
+        mapped_ {mapped_allocator {allocator}}
+    {
+    }
+
+    flat_map (
+        std::initializer_list <value_type> init,
+        const key_compare & compare = key_compare {},
+        const allocator_type & allocator = allocator_type {}
+    ) : flat_map {compare, allocator}
+    {
+        insert (init.begin (), init.end ());
+    }
+
+    template <class InputIterator>
+    flat_map (
+        InputIterator first,
+        InputIterator last,
+        const key_compare & compare = key_compare {},
+        const allocator_type & allocator = allocator_type {}
+    ) : flat_map {compare, allocator}
+    {
+        insert (first, last);
+    }
+
+    //
+    // From a range sorted by key, with no two equal keys, in O(n) and with
+    // both arrays allocated once if the range is a forward range.
+    // Throws std::invalid_argument if the range is not sorted and unique.
+    //
+    template <class InputIterator>
+    flat_map (
+        sorted_unique_t,
+        InputIterator first,
+        InputIterator last,
+        const key_compare & compare = key_compare {},
+        const allocator_type & allocator = allocator_type {}
+    ) : flat_map {compare, allocator}
+    {
+        reserve_for (
+            first, last,
+            typename std::iterator_traits <InputIterator>::iterator_category {}
+        );
+
+        for (; first != last; ++ first)
+        {
+            auto && value = * first;
+            if (! keys_.empty () && ! compare_ (keys_.back (), value.first))
+            {
+                throw std::invalid_argument {
+                    "flat_map: range is not sorted and unique"
+                };
+            }
+
+            keys_.push_back (value.first);
+            mapped_.push_back (value.second);
+        }
+    }
+
+    //
+    // Copy construction copies the key array and the mapped array.
+    //
+    flat_map (const flat_map & other) = default;
+    flat_map (flat_map && other) = default;
+    flat_map & operator = (const flat_map & other) = default;
+    flat_map & operator = (flat_map && other) = default;
+
+    const_iterator begin () const noexcept
+    {
+        return const_iterator {keys_.data (), mapped_.data ()};
+    }
+
+    const_iterator end () const noexcept
+    {
+        return begin () + size ();
+    }
+
+    const_iterator cbegin () const noexcept
+    {
+        return begin ();
+    }
+
+    const_iterator cend () const noexcept
+    {
+        return end ();
+    }
+
+    bool empty () const noexcept
+    {
+        return keys_.empty ();
+    }
+
+    size_type size () const noexcept
+    {
+        return keys_.size ();
+    }
+
+    size_type max_size () const noexcept
+    {
+        return std::min (keys_.max_size (), mapped_.max_size ());
+    }
+
+    allocator_type get_allocator () const noexcept
+    {
+        return allocator_type {keys_.get_allocator ()};
+    }
+
+    key_compare key_comp () const
+    {
+        return compare_;
+    }
+
+    const_iterator find (const key_type & key) const
+    {
+        auto pos = lower_index (key);
+        if (pos < size () && ! compare_ (key, keys_ [pos]))
+        {
+            return begin () + pos;
+        }
+
+        return end ();
+    }
+
+    size_type count (const key_type & key) const
+    {
+        return find (key) == end () ? 0 : 1;
+    }
+
+    const mapped_type & at (const key_type & key) const
+    {
+        auto itr = find (key);
+        if (itr == end ())
+        {
+            throw std::out_of_range {"flat_map::at"};
+        }
+
+        return * itr.mapped_;
+    }
+
+    //
+    // first element whose key is not less than key.
+    //
+    const_iterator lower_bound (const key_type & key) const
+    {
+        return begin () + lower_index (key);
+    }
+
+    //
+    // first element whose key is greater than key.
+    //
+    const_iterator upper_bound (const key_type & key) const
+    {
+        auto pos = lower_index (key);
+        if (pos < size () && ! compare_ (key, keys_ [pos]))
+        {
+            ++ pos;
+        }
+
+        return begin () + pos;
+    }
+
+    std::pair <const_iterator, const_iterator>
+    equal_range (const key_type & key) const
+    {
+        auto first = lower_bound (key);
+        auto last = first;
+        if (last != end () && ! compare_ (key, * last.key_))
+        {
+            ++ last;
+        }
+
+        return std::make_pair (first, last);
+    }
+
+    //
+    // Returned reference is valid until the next write to this flat_map.
+    //
+    mapped_type & operator [] (const key_type & key)
+    {
+        auto pos = lower_index (key);
+        if (pos == size () || compare_ (key, keys_ [pos]))
+        {
+            insert_at (pos, key, mapped_type {});
+        }
+
+        return mapped_ [pos];
+    }
+
+    std::pair <iterator, bool> insert (const value_type & value)
+    {
+        auto pos = lower_index (value.first);
+        if (pos < size () && ! compare_ (value.first, keys_ [pos]))
+        {
+            return std::make_pair (begin () + pos, false);
+        }
+
+        insert_at (pos, value.first, value.second);
+
+        return std::make_pair (begin () + pos, true);
+    }
+
+    template <class InputIterator>
+    void insert (InputIterator first, InputIterator last)
+    {
+        for (; first != last; ++ first)
+        {
+            insert (* first);
+        }
+    }
+
+    size_type erase (const key_type & key)
+    {
+        auto pos = lower_index (key);
+        if (pos == size () || compare_ (key, keys_ [pos]))
+        {
+            return 0;
+        }
+
+        keys_.erase (keys_.begin () + pos);
+        mapped_.erase (mapped_.begin () + pos);
+
+        return 1;
+    }
+
+    void clear () noexcept
+    {
+        keys_.clear ();
+        mapped_.clear ();
+    }
+
+private:
+    static void prefetch (const void * address)
+    {
+#if defined (__GNUC__)
+        __builtin_prefetch (address);
+#else
+        (void) address;
+#endif
+    }
+
+    //
+    // index of the first key not less than key.
+    // Each step halves the range [base, base + length) that holds the
+    // answer, keeping its first or its second half with a conditional move.
+    //
+    size_type lower_index (const key_type & key) const
+    {
+        auto length = size ();
+        if (length == 0)
+        {
+            return 0;
+        }
+
+        const key_type * first = keys_.data ();
+        const key_type * base = first;
+        while (length > 1)
+        {
+            auto half = length / 2;
+            prefetch (base + half / 2);
+            prefetch (base + half + half / 2);
+            base = compare_ (base [half], key) ? base + half : base;
+            length -= half;
+        }
+
+        return (base - first) + (compare_ (* base, key) ? 1 : 0);
+    }
+
+    template <class ForwardIterator>
+    void reserve_for (
+        ForwardIterator first,
+        ForwardIterator last,
+        std::forward_iterator_tag
+    )
+    {
+        auto n = static_cast <size_type> (std::distance (first, last));
+        keys_.reserve (n);
+        mapped_.reserve (n);
+    }
+
+    template <class InputIterator>
+    void reserve_for (InputIterator, InputIterator, std::input_iterator_tag)
+    {
+    }
+
+    //
+    // Insert key and mapped at pos, keeping both arrays the same size if
+    // either insert throws.
+    //
+    template <typename M>
+    void insert_at (size_type pos, const key_type & key, M && mapped)
+    {
+        keys_.insert (keys_.begin () + pos, key);
+        try
+        {
+            mapped_.insert (mapped_.begin () + pos, std::forward <M> (mapped));
+        }
+        catch (...)
+        {
+            keys_.erase (keys_.begin () + pos);
+            throw;
+        }
+    }
+
+    std::vector <key_type, key_allocator> keys_;
+    std::vector <mapped_type, mapped_allocator> mapped_;
+    key_compare compare_;
+};
+
+//
+// lockfree::map whose implementation is a sorted array. Fastest lookups and
+// clones of the ordered maps, for maps that are rarely written.
+//
+template <
+    typename Key,
+    typename Mapped,
+    typename Compare = std::less <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using sorted_vector_map = map_template <
+    flat_map <Key, Mapped, Compare, Allocator>
+>;
+
+}
@@ -0,0 +1,789 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Persistent hash array mapped trie for use as the Implementation of
+//      lockfree::map_template.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "map.h"
+
+/*
+Notes:
+1.  hamt_map is an unordered map with the interface of std::unordered_map
+    that map_template needs. It is a hash array mapped trie in which every
+    node has 32 slots, indexed by 5 bits of the hash of a key.
+2.  Nodes are shared between copies of a hamt_map. Copy construction only
+    copies the root pointer. A write copies the path from the root to the
+    changed entry, O(log32 n) nodes, and shares all other nodes. So the
+    cost of a lockfree write no longer grows with the size of the map.
+3.  A node is never changed once it is reachable from more than one
+    hamt_map. Nodes that are exclusively owned, ie nodes already copied by
+    an earlier write to the same hamt_map, are changed in place. This makes
+    a batch of writes to one clone (see map_template::transaction) copy each
+    path only once.
+4.  Unlike std::unordered_map, every write invalidates all iterators,
+    pointers and references to elements, like std::vector does.
+*/
+
+namespace lockfree
+{
+
+template <
+    typename Key,
+    typename Mapped,
+    typename Hash = std::hash <Key>,
+    typename Predicate = std::equal_to <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+class hamt_map
+{
+public:
+    using key_type = Key;
+    using mapped_type = Mapped;
+    using value_type = std::pair <const Key, Mapped>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using hasher = Hash;
+    using key_equal = Predicate;
+    using allocator_type = Allocator;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+
+private:
+    struct node;
+
+    using allocator_traits = std::allocator_traits <allocator_type>;
+    using node_allocator =
+        typename allocator_traits::template rebind_alloc <node>;
+    using node_ptr = std::shared_ptr <node>;
+    using entries_type = std::vector <
+        value_type,
+        typename allocator_traits::template rebind_alloc <value_type>
+    >;
+    using children_type = std::vector <
+        node_ptr,
+        typename allocator_traits::template rebind_alloc <node_ptr>
+    >;
+
+    static constexpr unsigned bits_per_level = 5;
+    static constexpr unsigned hash_bits = (
+        std::numeric_limits <std::size_t>::digits
+    );
+
+    //
+    // Entries and children are kept compact, in the order of their slots.
+    // A node below the last level of hash bits is a collision node. It has
+    // no children and no maps, and holds entries of equal hashes.
+    //
+    struct node
+    {
+        explicit node (const allocator_type & allocator) :
+            entries (allocator),
+            children (allocator)
+        {
+        }
+
+        std::uint32_t datamap = 0;
+        std::uint32_t nodemap = 0;
+        entries_type entries;
+        children_type children;
+    };
+
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename hamt_map::value_type;
+        using difference_type = typename hamt_map::difference_type;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+
+        const_iterator () = default;
+
+        reference operator * () const
+        {
+            const auto & top = path_ [depth_ - 1];
+            return top.n->entries [top.pos];
+        }
+
+        pointer operator -> () const
+        {
+            return & (** this);
+        }
+
+        const_iterator & operator ++ ()
+        {
+            ++ path_ [depth_ - 1].pos;
+            settle ();
+            return * this;
+        }
+
+        const_iterator operator ++ (int)
+        {
+            auto itr = * this;
+            ++ (* this);
+            return itr;
+        }
+
+        bool operator == (const const_iterator & other) const
+        {
+            if (depth_ == 0 || other.depth_ == 0)
+            {
+                return depth_ == other.depth_;
+            }
+
+            const auto & top = path_ [depth_ - 1];
+            const auto & other_top = other.path_ [other.depth_ - 1];
+            return top.n == other_top.n && top.pos == other_top.pos;
+        }
+
+        bool operator != (const const_iterator & other) const
+        {
+            return ! (* this == other);
+        }
+
+    private:
+        //
+        // A frame of the path from the root to the current entry.
+        // pos indexes the entries of the node followed by its children.
+        //
+        struct frame
+        {
+            const node * n;
+            std::size_t pos;
+        };
+
+        // one frame per level of hash bits, plus one for collision nodes.
+        static constexpr unsigned max_depth = (
+            (hash_bits + bits_per_level - 1) / bits_per_level + 1
+        );
+
+        explicit const_iterator (const node * root)
+        {
+            if (root)
+            {
+                push (root, 0);
+                settle ();
+            }
+        }
+
+        void push (const node * n, std::size_t pos)
+        {
+            path_ [depth_ ++] = frame {n, pos};
+        }
+
+        //
+        // move to the first entry at or after the current position.
+        //
+        void settle ()
+        {
+            while (depth_ != 0)
+            {
+                auto & top = path_ [depth_ - 1];
+                auto entries = top.n->entries.size ();
+                if (top.pos < entries)
+                {
+                    return;
+                }
+
+                auto child = top.pos - entries;
+                if (child < top.n->children.size ())
+                {
+                    push (top.n->children [child].get (), 0);
+                    continue;
+                }
+
+                if (-- depth_ != 0)
+                {
+                    ++ path_ [depth_ - 1].pos;
+                }
+            }
+        }
+
+        frame path_ [max_depth];
+        unsigned depth_ = 0;
+
+        friend hamt_map;
+    };
+
+    // all elements are immutable through an iterator, as in std::set.
+    using iterator = const_iterator;
+
+    hamt_map () = default;
+
+    explicit hamt_map (const allocator_type & allocator) :
+        allocator_ {allocator}
+    {
+    }
+
+    hamt_map (
+        std::initializer_list <value_type> init,
+        const hasher & hash = hasher {},
+        const key_equal & equal = key_equal {},
+        const allocator_type & allocator = allocator_type {}
+    ) : hash_ {hash}, equal_ {equal}, allocator_ {allocator}
+    {
+        insert (init.begin (), init.end ());
+    }
+
+    template <class InputIterator>
+    hamt_map (
+        InputIterator first,
+        InputIterator last,
+        const hasher & hash = hasher {},
+        const key_equal & equal = key_equal {},
+        const allocator_type & allocator = allocator_type {}
+    ) : hash_ {hash}, equal_ {equal}, allocator_ {allocator}
+    {
+        insert (first, last);
+    }
+
+    //
+    // Copy construction shares all nodes with other. O(1).
+    //
+    hamt_map (const hamt_map & other) = default;
+
+    hamt_map (hamt_map && other) noexcept :
+        root_ {std::move (other.root_)},
+        size_ {other.size_},
+        hash_ {std::move (other.hash_)},
+        equal_ {std::move (other.equal_)},
+        allocator_ {other.allocator_}
+    {
+        other.size_ = 0;
+    }
+
+    hamt_map & operator = (const hamt_map & other) = default;
+
+    hamt_map & operator = (hamt_map && other) noexcept
+    {
+        if (this != & other)
+        {
+            root_ = std::move (other.root_);
+            size_ = other.size_;
+            hash_ = std::move (other.hash_);
+            equal_ = std::move (other.equal_);
+            allocator_ = other.allocator_;
+            other.size_ = 0;
+        }
+
+        return * this;
+    }
+
+    const_iterator begin () const noexcept
+    {
+        return const_iterator {root_.get ()};
+    }
+
+    const_iterator end () const noexcept
+    {
+        return const_iterator {};
+    }
+
+    const_iterator cbegin () const noexcept
+    {
+        return begin ();
+    }
+
+    const_iterator cend () const noexcept
+    {
+        return end ();
+    }
+
+    bool empty () const noexcept
+    {
+        return size_ == 0;
+    }
+
+    size_type size () const noexcept
+    {
+        return size_;
+    }
+
+    //
+    // Elements and bytes copied by copy construction, for the stats of a
+    // map_template. None, since copies share all nodes.
+    //
+    std::pair <size_type, std::size_t> clone_cost () const noexcept
+    {
+        return std::make_pair (size_type {0}, std::size_t {0});
+    }
+
+    size_type max_size () const noexcept
+    {
+        return std::numeric_limits <difference_type>::max () /
+            sizeof (value_type);
+    }
+
+    allocator_type get_allocator () const noexcept
+    {
+        return allocator_;
+    }
+
+    hasher hash_function () const
+    {
+        return hash_;
+    }
+
+    key_equal key_eq () const
+    {
+        return equal_;
+    }
+
+    const_iterator find (const key_type & key) const
+    {
+        const_iterator itr;
+
+        auto h = hash (key);
+        unsigned shift = 0;
+        for (auto n = root_.get (); n; shift += bits_per_level)
+        {
+            if (shift >= hash_bits)
+            {
+                for (std::size_t i = 0; i < n->entries.size (); ++ i)
+                {
+                    if (equal_ (n->entries [i].first, key))
+                    {
+                        itr.push (n, i);
+                        return itr;
+                    }
+                }
+                break;
+            }
+
+            auto bit = slot_bit (h, shift);
+            if (n->datamap & bit)
+            {
+                auto i = index (n->datamap, bit);
+                if (equal_ (n->entries [i].first, key))
+                {
+                    itr.push (n, i);
+                    return itr;
+                }
+                break;
+            }
+
+            if (! (n->nodemap & bit))
+            {
+                break;
+            }
+
+            auto i = index (n->nodemap, bit);
+            itr.push (n, n->entries.size () + i);
+            n = n->children [i].get ();
+        }
+
+        return end ();
+    }
+
+    size_type count (const key_type & key) const
+    {
+        return find (key) == end () ? 0 : 1;
+    }
+
+    //
+    // Prefetch the node below the root that find (key) goes to, if any.
+    // The root itself is read by every lookup, so it is likely cached.
+    // See map_template::find_many.
+    //
+    void prefetch (const key_type & key) const
+    {
+        auto n = root_.get ();
+        if (! n)
+        {
+            return;
+        }
+
+        auto bit = slot_bit (hash (key), 0);
+        if (n->nodemap & bit)
+        {
+            prefetch_line (n->children [index (n->nodemap, bit)].get ());
+        }
+    }
+
+    const mapped_type & at (const key_type & key) const
+    {
+        auto itr = find (key);
+        if (itr == end ())
+        {
+            throw std::out_of_range {"hamt_map::at"};
+        }
+
+        return itr->second;
+    }
+
+    std::pair <const_iterator, const_iterator>
+    equal_range (const key_type & key) const
+    {
+        auto first = find (key);
+        auto last = first;
+        if (last != end ())
+        {
+            ++ last;
+        }
+
+        return std::make_pair (first, last);
+    }
+
+    //
+    // Returned reference is valid until the next write to this hamt_map.
+    //
+    mapped_type & operator [] (const key_type & key)
+    {
+        return locate (key, [&key] () {
+            return value_type {key, mapped_type {}};
+        })->second;
+    }
+
+    std::pair <iterator, bool> insert (const value_type & value)
+    {
+        auto itr = find (value.first);
+        if (itr != end ())
+        {
+            return std::make_pair (itr, false);
+        }
+
+        locate (value.first, [&value] () { return value; });
+
+        return std::make_pair (find (value.first), true);
+    }
+
+    template <class InputIterator>
+    void insert (InputIterator first, InputIterator last)
+    {
+        for (; first != last; ++ first)
+        {
+            const value_type & value = * first;
+            if (find (value.first) == end ())
+            {
+                locate (value.first, [&value] () { return value; });
+            }
+        }
+    }
+
+    size_type erase (const key_type & key)
+    {
+        if (find (key) == end ())
+        {
+            return 0;
+        }
+
+        erase_below (root_, key, hash (key), 0);
+        -- size_;
+
+        if (root_->entries.empty () && root_->children.empty ())
+        {
+            root_.reset ();
+        }
+
+        return 1;
+    }
+
+    void clear () noexcept
+    {
+        root_.reset ();
+        size_ = 0;
+    }
+
+private:
+    std::size_t hash (const key_type & key) const
+    {
+        return mix (hash_ (key));
+    }
+
+    //
+    // std::hash of integers is typically the identity. Mix all bits of the
+    // hash into the low bits used by the top levels of the trie.
+    //
+    static std::size_t mix (std::uint64_t h)
+    {
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return static_cast <std::size_t> (h);
+    }
+
+    static std::uint32_t slot_bit (std::size_t h, unsigned shift)
+    {
+        return std::uint32_t {1} << ((h >> shift) & 0x1f);
+    }
+
+    //
+    // index of the slot bit among the set bits of map.
+    //
+    static std::size_t index (std::uint32_t map, std::uint32_t bit)
+    {
+        return popcount (map & (bit - 1));
+    }
+
+    static void prefetch_line (const void * address)
+    {
+#if defined (__GNUC__)
+        __builtin_prefetch (address);
+#else
+        (void) address;
+#endif
+    }
+
+    static unsigned popcount (std::uint32_t x)
+    {
+#if defined (__GNUC__)
+        return __builtin_popcount (x);
+#else
+        x = x - ((x >> 1) & 0x55555555);
+        x = (x & 0x33333333) + ((x >> 2) & 0x33333333);
+        return (((x + (x >> 4)) & 0x0f0f0f0f) * 0x01010101) >> 24;
+#endif
+    }
+
+    node_ptr make_node () const
+    {
+        return std::allocate_shared <node> (
+            node_allocator {allocator_}, allocator_
+        );
+    }
+
+    //
+    // Make the node in slot exclusively owned by this hamt_map, copying it
+    // if it is shared. The caller must have made the parent exclusive.
+    //
+    void make_exclusive (node_ptr & slot) const
+    {
+        if (slot.use_count () == 1)
+        {
+            // pairs with the release by the last other owner when it let go,
+            // so its reads of the node happen before our writes.
+            std::atomic_thread_fence (std::memory_order_acquire);
+        }
+        else
+        {
+            slot = std::allocate_shared <node> (
+                node_allocator {allocator_}, * slot
+            );
+        }
+    }
+
+    //
+    // Find the entry of key, copying the path to it. If it does not exist
+    // insert make (). Returns the entry, which is in an exclusive node.
+    //
+    template <typename Make>
+    value_type * locate (const key_type & key, Make make)
+    {
+        auto h = hash (key);
+        node_ptr * slot = & root_;
+        for (unsigned shift = 0; ; shift += bits_per_level)
+        {
+            if (! * slot)
+            {
+                * slot = make_node ();
+            }
+            else
+            {
+                make_exclusive (* slot);
+            }
+            auto & n = ** slot;
+
+            if (shift >= hash_bits)
+            {
+                for (auto & entry : n.entries)
+                {
+                    if (equal_ (entry.first, key))
+                    {
+                        return & entry;
+                    }
+                }
+
+                n.entries.push_back (make ());
+                ++ size_;
+                return & n.entries.back ();
+            }
+
+            auto bit = slot_bit (h, shift);
+            if (n.nodemap & bit)
+            {
+                slot = & n.children [index (n.nodemap, bit)];
+                continue;
+            }
+
+            auto i = index (n.datamap, bit);
+            if (! (n.datamap & bit))
+            {
+                // free slot.
+                entries_type entries (allocator_);
+                entries.reserve (n.entries.size () + 1);
+                move_entries (n.entries, 0, i, entries);
+                entries.push_back (make ());
+                move_entries (n.entries, i, n.entries.size (), entries);
+                n.entries.swap (entries);
+                n.datamap |= bit;
+                ++ size_;
+                return & n.entries [i];
+            }
+
+            if (equal_ (n.entries [i].first, key))
+            {
+                return & n.entries [i];
+            }
+
+            // slot holds another key. Push both keys down to a new child.
+            auto child = make_node ();
+            child->entries.reserve (2);
+            child->entries.push_back (std::move (n.entries [i]));
+
+            entries_type entries (allocator_);
+            entries.reserve (n.entries.size () - 1);
+            move_entries (n.entries, 0, i, entries);
+            move_entries (n.entries, i + 1, n.entries.size (), entries);
+            n.entries.swap (entries);
+            n.datamap &= ~bit;
+
+            auto c = index (n.nodemap, bit);
+            split (* child, hash (child->entries [0].first), shift);
+
+            // moved, so that the child stays exclusive.
+            n.children.insert (n.children.begin () + c, std::move (child));
+            n.nodemap |= bit;
+            slot = & n.children [c];
+        }
+    }
+
+    //
+    // Distribute the single entry of a new child one level down, so that a
+    // new key at that level lands in its own slot, or in a deeper child.
+    // shift is the level of the parent of the child.
+    //
+    void split (node & child, std::size_t h, unsigned shift) const
+    {
+        shift += bits_per_level;
+        if (shift < hash_bits)
+        {
+            child.datamap = slot_bit (h, shift);
+        }
+    }
+
+    static void move_entries (
+        entries_type & from,
+        std::size_t first,
+        std::size_t last,
+        entries_type & to
+    )
+    {
+        for (auto i = first; i < last; ++ i)
+        {
+            to.push_back (std::move (from [i]));
+        }
+    }
+
+    //
+    // Erase an existing key below slot, copying the path to it.
+    // Empty nodes are removed, and a child left with a single entry is
+    // folded into its parent.
+    //
+    void erase_below (
+        node_ptr & slot,
+        const key_type & key,
+        std::size_t h,
+        unsigned shift
+    )
+    {
+        make_exclusive (slot);
+        auto & n = * slot;
+
+        if (shift >= hash_bits)
+        {
+            for (std::size_t i = 0; i < n.entries.size (); ++ i)
+            {
+                if (equal_ (n.entries [i].first, key))
+                {
+                    remove_entry (n, i);
+                    break;
+                }
+            }
+            return;
+        }
+
+        auto bit = slot_bit (h, shift);
+        if (n.datamap & bit)
+        {
+            remove_entry (n, index (n.datamap, bit));
+            n.datamap &= ~bit;
+            return;
+        }
+
+        auto c = index (n.nodemap, bit);
+        erase_below (n.children [c], key, h, shift + bits_per_level);
+
+        auto & child = * n.children [c];
+        if (child.children.empty () && child.entries.size () <= 1)
+        {
+            if (! child.entries.empty ())
+            {
+                // fold the single entry into this node.
+                auto i = index (n.datamap, bit);
+                entries_type entries (allocator_);
+                entries.reserve (n.entries.size () + 1);
+                move_entries (n.entries, 0, i, entries);
+                entries.push_back (std::move (child.entries [0]));
+                move_entries (n.entries, i, n.entries.size (), entries);
+                n.entries.swap (entries);
+                n.datamap |= bit;
+            }
+
+            n.children.erase (n.children.begin () + c);
+            n.nodemap &= ~bit;
+        }
+    }
+
+    void remove_entry (node & n, std::size_t i) const
+    {
+        entries_type entries (allocator_);
+        entries.reserve (n.entries.size () - 1);
+        move_entries (n.entries, 0, i, entries);
+        move_entries (n.entries, i + 1, n.entries.size (), entries);
+        n.entries.swap (entries);
+    }
+
+    node_ptr root_;
+    size_type size_ = 0;
+    hasher hash_;
+    key_equal equal_;
+    allocator_type allocator_;
+};
+
+//
+// lockfree::unordered_map whose writes copy O(log32 n) nodes of a persistent
+// hash array mapped trie instead of the whole map.
+//
+template <
+    typename Key,
+    typename Mapped,
+    typename Hash = std::hash<Key>,
+    typename Predicate = std::equal_to <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using persistent_unordered_map = map_template <
+    hamt_map <Key, Mapped, Hash, Predicate, Allocator>
+>;
+
+}
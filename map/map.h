@@ -10,10 +10,25 @@
 #pragma once
 
 #include <map>
+#include <vector>
 #include <unordered_map>
 #include <memory>
 #include <atomic>
+#include <cstdint>
+#include <thread>
+#include <exception>
+#include <stdexcept>
 #include <iostream>
+#include <iterator>
+#include <type_traits>
+#if __cplusplus >= 201703L
+#include <optional>
+#endif
+
+#include "../atomic_ptr/atomic_ptr.h"
+#include "../epoch/epoch.h"
+#include "../reclaimer/reclaimer.h"
+#include "stats.h"
 
 /*
 Notes:
@@ -28,6 +43,13 @@ Notes:
     allocators like a not too old version of libc malloc
     (or tcmalloc / jemalloc etc). If you have multi-threaded code, you are most
     likely already using one.
+4.  The current implementation is held by a lockfree::atomic_shared_ptr.
+    std::atomic_load etc. of a std::shared_ptr are not lock-free with common
+    standard libraries. See atomic_ptr.h.
+5.  Members that return no iterator, eg at, count and size, read the current
+    implementation through atomic_read. With epoch_policy such reads take no
+    reference count on the implementation, so concurrent readers write no
+    shared cache line. See epoch.h.
 */
 
 namespace lockfree
@@ -35,20 +57,247 @@ namespace lockfree
 
 using std::shared_ptr;
 
+//
+// Tag of the constructor of an implementation from a range that is sorted
+// by key, with no two equal keys, eg
+//      lockfree::flat_map <int, int> m {lockfree::sorted_unique, f, l};
+// Such a constructor builds the implementation in O(n). See
+// map_template::from_sorted.
+//
+struct sorted_unique_t
+{
+};
+
+constexpr sorted_unique_t sorted_unique {};
+
+template <typename T>
+struct map_void
+{
+    using type = void;
+};
+
+//
+// The key_compare of Implementation if it has one, else its hasher and
+// key_equal. An implementation over another map, eg delta_map, derives
+// from key_functions of that map, so that it is ordered or hashed alike.
+//
+template <typename Implementation, typename = void>
+struct key_functions
+{
+    using hasher = typename Implementation::hasher;
+    using key_equal = typename Implementation::key_equal;
+};
+
+template <typename Implementation>
+struct key_functions <
+    Implementation,
+    typename map_void <typename Implementation::key_compare>::type
+>
+{
+    using key_compare = typename Implementation::key_compare;
+};
+
+//
+// Map from pointers to keys of Implementation, with the same ordering or
+// hashing as Implementation, to Value. Neither copies nor allocates a key.
+//
+template <typename Implementation, typename Value, typename = void>
+struct key_pointer_map
+{
+    using key_type = typename Implementation::key_type;
+
+    struct hash : private Implementation::hasher
+    {
+        std::size_t operator () (const key_type * k) const
+        {
+            return Implementation::hasher::operator () (* k);
+        }
+    };
+
+    struct equal : private Implementation::key_equal
+    {
+        bool operator () (const key_type * a, const key_type * b) const
+        {
+            return Implementation::key_equal::operator () (* a, * b);
+        }
+    };
+
+    using type = std::unordered_map <const key_type *, Value, hash, equal>;
+};
+
+template <typename Implementation, typename Value>
+struct key_pointer_map <
+    Implementation,
+    Value,
+    typename map_void <typename Implementation::key_compare>::type
+>
+{
+    using key_type = typename Implementation::key_type;
+
+    struct compare : private Implementation::key_compare
+    {
+        bool operator () (const key_type * a, const key_type * b) const
+        {
+            return Implementation::key_compare::operator () (* a, * b);
+        }
+    };
+
+    using type = std::map <const key_type *, Value, compare>;
+};
+
+//
+// A policy selects how map_template publishes writes.
+// To change one member of a policy, derive from default_policy and override
+// just that member. eg
+// struct my_policy : lockfree::default_policy
+// {
+//     static constexpr bool combining_writes = true;
+// };
+//
+struct default_policy
+{
+    //
+    // When false, every writer clones the implementation and compare
+    // exchanges its clone on its own. Concurrent writers race and all but
+    // one of them throw their clone away.
+    // When true, concurrent writers are flat combined. Every writer posts
+    // its write to a publication list and one of them, the combiner, applies
+    // all the posted writes to a single clone and publishes it. A writer
+    // returns once the snapshot with its write is published.
+    // Note that combined writers are not lock-free: a writer whose write is
+    // taken by a combiner waits for that combiner. Readers are not affected.
+    //
+    static constexpr bool combining_writes = false;
+
+    //
+    // The atomic pointer that holds the current implementation.
+    // With atomic_shared_ptr, every read takes and drops a reference count
+    // on the implementation, which is a write to a cache line shared by all
+    // readers.
+    // With epoch_ptr, reads that return no iterator only pin an epoch in a
+    // record of their own thread. A replaced implementation is freed once
+    // every thread has unpinned the epochs it could have been read in.
+    //
+    template <typename T>
+    using snapshot_ptr = atomic_shared_ptr <T>;
+
+    //
+    // Makes every implementation that is published.
+    // With std::make_shared, the thread that drops the last reference to a
+    // replaced implementation destroys it, often a reader.
+    //
+    template <typename T, typename... Args>
+    static shared_ptr <T> make_implementation (Args && ... args)
+    {
+        return std::make_shared <T> (std::forward <Args> (args)...);
+    }
+
+    //
+    // Contention management of writers that are not combined.
+    // backoff is called after the attempt-th failed compare exchange of a
+    // write, before the write retries on a new clone.
+    // A write whose compare exchange fails max_retries times escalates:
+    // writes that have not escalated wait before each attempt until no
+    // write is escalated, so that a large write, eg of a whole range, is
+    // not starved by a stream of small ones. Waiting writes are not
+    // lock-free. 0 never escalates.
+    //
+    static void backoff (unsigned attempt)
+    {
+        (void) attempt;
+    }
+
+    static constexpr unsigned max_retries = 0;
+
+    //
+    // Operation counters and latency histograms, read by
+    // map_template::stats(). no_stats records nothing. See stats.h.
+    //
+    using stats_type = no_stats;
+};
+
+//
+// Exponential backoff, and escalation after a few retries.
+//
+struct contention_policy : default_policy
+{
+    static void backoff (unsigned attempt)
+    {
+        if (attempt > max_spin_shift)
+        {
+            std::this_thread::yield ();
+            return;
+        }
+
+        for (unsigned i = 0; i < (1u << attempt); ++ i)
+        {
+#if defined (__GNUC__) && (defined (__x86_64__) || defined (__i386__))
+            __builtin_ia32_pause ();
+#elif defined (__GNUC__)
+            __asm__ __volatile__ ("" ::: "memory");
+#endif
+        }
+    }
+
+    static constexpr unsigned max_retries = 8;
+
+    // up to 2^max_spin_shift spins, then yield.
+    static constexpr unsigned max_spin_shift = 10;
+};
+
+struct stats_policy : default_policy
+{
+    using stats_type = sharded_stats;
+};
+
+struct combining_policy : default_policy
+{
+    static constexpr bool combining_writes = true;
+};
+
+struct epoch_policy : default_policy
+{
+    template <typename T>
+    using snapshot_ptr = epoch_ptr <T>;
+};
+
+//
+// Replaced implementations are destroyed by the reclaimer thread, so that
+// no reader or writer pays for the destruction of a whole map. See
+// reclaimer.h.
+//
+struct deferred_reclamation_policy : default_policy
+{
+    template <typename T, typename... Args>
+    static shared_ptr <T> make_implementation (Args && ... args)
+    {
+        return reclaimer::make_shared <T> (std::forward <Args> (args)...);
+    }
+};
+
 template <
-    typename Implementation
+    typename Implementation,
+    typename Policy = default_policy
 >
 class map_template
 {
 public:
     using implementation_type = Implementation;
-    using this_type = map_template <implementation_type>;
+    using policy_type = Policy;
+    using this_type = map_template <implementation_type, policy_type>;
     using container_type = this_type;
     using key_type = typename implementation_type::key_type;
     using mapped_type = typename implementation_type::mapped_type;
     using value_type = typename implementation_type::value_type;
     using size_type = typename implementation_type::size_type;
     using allocator_type = typename implementation_type::allocator_type;
+    using stats_type = typename policy_type::stats_type;
+
+    //
+    // Pointer to a mapped that shares ownership of the version of the map
+    // the mapped is in. See pin().
+    //
+    using pinned_mapped = shared_ptr <const mapped_type>;
 
     map_template ()
     {
@@ -60,7 +309,7 @@ public:
 #endif
         }
 
-        auto implementation = std::make_shared <implementation_type> ();
+        auto implementation = make_implementation ();
 
         atomic_store (& implementation_, implementation);
     }
@@ -73,9 +322,7 @@ public:
         auto other_implementation = atomic_load (& (other.implementation_));
 
         // copy construct implementation
-        auto implementation = (
-            std::make_shared <implementation_type> (* other_implementation)
-        );
+        auto implementation = clone (* other_implementation);
 
         atomic_store (& implementation_, implementation);
     }
@@ -85,7 +332,7 @@ public:
     //
     map_template (this_type && other)
     {
-        auto implementation = std::make_shared <implementation_type> ();
+        auto implementation = make_implementation ();
 
         auto other_implementation = (
             atomic_exchange (& (other.implementation_), implementation)
@@ -111,7 +358,7 @@ public:
         }
 
         // This call will invoke the move constructor of implementation_type.
-        auto implementation = std::make_shared <implementation_type> (
+        auto implementation = make_implementation (
             std::forward <implementation_type> (imp)
         );
 
@@ -128,9 +375,7 @@ public:
             auto other_implementation = atomic_load (& (other.implementation_));
 
             // clone other_implementation by copy construction.
-            auto implementation = (
-                std::make_shared <implementation_type> (* other_implementation)
-            );
+            auto implementation = clone (* other_implementation);
 
             atomic_store (& implementation_, implementation);
         }
@@ -145,7 +390,7 @@ public:
     {
         if (this != & other)
         {
-            auto implementation = std::make_shared <implementation_type> ();
+            auto implementation = make_implementation ();
 
             auto other_implementation = (
                 atomic_exchange (& (other.implementation_), implementation)
@@ -166,13 +411,42 @@ public:
     void operator = (implementation_type && imp)
     {
         // This call will invoke the move constructor of implementation_type.
-        auto implementation = std::make_shared <implementation_type> (
+        auto implementation = make_implementation (
             std::forward <implementation_type> (imp)
         );
 
         atomic_store (& implementation_, implementation);
     }
 
+    //
+    // Not in std::map.
+    // A map of the elements of [first, last), which must be sorted by key,
+    // with no two equal keys.
+    // An implementation with a sorted_unique constructor, eg flat_map or
+    // btree_map, is built in O(n), in storage sized for the elements.
+    // Otherwise each element is inserted with the end of the map as hint,
+    // which is amortized O(1) for std::map, and std::unordered_map is
+    // reserved first. Only implementations with neither, eg hamt_map, are
+    // built with insert (first, last).
+    //
+    template <class InputIterator>
+    static this_type from_sorted (InputIterator first, InputIterator last)
+    {
+        return this_type {build_sorted (first, last, 0)};
+    }
+
+    //
+    // Not in std::map.
+    // Replace all elements of the map by the elements of the sorted range
+    // [first, last), like from_sorted. The new version is built before the
+    // write, and published with a single store, like clear().
+    //
+    template <class InputIterator>
+    void bulk_load (InputIterator first, InputIterator last)
+    {
+        * this = build_sorted (first, last, 0);
+    }
+
     //
     // Cannot swap two atomics atomically.
     //
@@ -185,12 +459,186 @@ public:
     // Cannot return mapped by reference because the lifetime of the
     // implementation is only guaranteed until the return of this function,
     // whereas the returned reference to mapped may be held beyond that.
+    // To read a large mapped without copying it, use pin(key).
     //
     mapped_type at (const key_type & key) const
     {
-        auto implementation = atomic_load (&implementation_);
+        return read (
+            [&] (const implementation_type & implementation)
+            {
+                return mapped_type {implementation.at (key)};
+            }
+        );
+    }
+
+    //
+    // Not in std::map.
+    // Like at(key), but a missing key is not an exception. Returns whether
+    // key is in the map, and if so copies its mapped to mapped.
+    //
+    bool try_get (const key_type & key, mapped_type & mapped) const
+    {
+        return read (
+            [&] (const implementation_type & implementation) -> bool
+            {
+                auto itr = implementation.find (key);
+                if (itr == implementation.end ())
+                {
+                    return false;
+                }
+
+                mapped = itr->second;
+                return true;
+            }
+        );
+    }
+
+#if __cplusplus >= 201703L
+    std::optional <mapped_type> try_get (const key_type & key) const
+    {
+        return read (
+            [&] (const implementation_type & implementation)
+                -> std::optional <mapped_type>
+            {
+                auto itr = implementation.find (key);
+                if (itr == implementation.end ())
+                {
+                    return std::nullopt;
+                }
+
+                return itr->second;
+            }
+        );
+    }
+#endif
+
+    //
+    // Not in std::map.
+    // The mapped of key, or otherwise if key is not in the map.
+    //
+    mapped_type get_or (
+        const key_type & key,
+        const mapped_type & otherwise
+    ) const
+    {
+        return read (
+            [&] (const implementation_type & implementation) -> mapped_type
+            {
+                auto itr = implementation.find (key);
+                if (itr == implementation.end ())
+                {
+                    return otherwise;
+                }
+
+                return itr->second;
+            }
+        );
+    }
+
+    //
+    // Not in std::map.
+    // A pointer to the mapped of key, or null if key is not in the map.
+    // The pointer holds on to the version of the map it was read from, so
+    // the mapped is not copied, and stays valid and unchanged for as long as
+    // the pointer is held, however many writes are published meanwhile.
+    // Costs one reference count on the version, and no allocation. Like a
+    // snapshot, do not hold a pinned mapped longer than needed.
+    //
+    pinned_mapped pin (const key_type & key) const
+    {
+        timed op {stats_, false};
+        shared_ptr <const implementation_type> implementation = (
+            atomic_load (& implementation_)
+        );
+
+        auto itr = implementation->find (key);
+        if (itr == implementation->end ())
+        {
+            return pinned_mapped {};
+        }
+
+        // aliasing constructor: owns the version, points to the mapped.
+        return pinned_mapped {std::move (implementation), & itr->second};
+    }
+
+    //
+    // Not in std::map.
+    // Look up each key of the forward range [first, last) in one version of
+    // the map, and write its pin(key) to out, in the order of the keys.
+    // Returns the number of keys found.
+    // Costs one snapshot load for the whole batch, and one reference count
+    // per key found. The lookups are done in groups: the memory of every key
+    // in a group is prefetched before any key in it is probed, so their
+    // cache misses overlap. See find_each.
+    //
+    template <typename KeyIterator, typename OutputIterator>
+    size_type find_many (
+        KeyIterator first,
+        KeyIterator last,
+        OutputIterator out
+    ) const
+    {
+        timed op {stats_, false};
+        shared_ptr <const implementation_type> implementation = (
+            atomic_load (& implementation_)
+        );
+
+        size_type found = 0;
+        find_each (
+            * implementation, first, last,
+            [&] (const typename implementation_type::const_iterator & itr)
+            {
+                if (itr == implementation->end ())
+                {
+                    * out ++ = pinned_mapped {};
+                    return;
+                }
+
+                * out ++ = pinned_mapped {implementation, & itr->second};
+                ++ found;
+            }
+        );
+
+        return found;
+    }
 
-        return implementation->at (key);
+    //
+    // Not in std::map.
+    // Like find_many, but writes a copy of the mapped of each key to out,
+    // like at(key). Throws std::out_of_range at the first key that is not
+    // in the map. Returns out past the last mapped written.
+    //
+    template <typename KeyIterator, typename OutputIterator>
+    OutputIterator at_many (
+        KeyIterator first,
+        KeyIterator last,
+        OutputIterator out
+    ) const
+    {
+        return read (
+            [&] (const implementation_type & implementation)
+            {
+                find_each (
+                    implementation, first, last,
+                    [&] (
+                        const typename implementation_type::const_iterator &
+                            itr
+                    )
+                    {
+                        if (itr == implementation.end ())
+                        {
+                            throw std::out_of_range {
+                                "lockfree::map_template::at_many"
+                            };
+                        }
+
+                        * out ++ = itr->second;
+                    }
+                );
+
+                return out;
+            }
+        );
     }
 
     //
@@ -211,6 +659,12 @@ public:
             return * this;
         }
 
+        reference_to_mapped & operator = (mapped_type && mapped)
+        {
+            pContainer_->set_mapped (key_, std::move (mapped));
+            return * this;
+        }
+
     private:
         reference_to_mapped (
             container_type * pContainer,
@@ -233,34 +687,170 @@ public:
 
     bool empty () const noexcept
     {
-        auto implementation = atomic_load (& implementation_);
-
-        return implementation->empty ();
+        return read (
+            [] (const implementation_type & implementation)
+            {
+                return implementation.empty ();
+            }
+        );
     }
 
     size_type size () const noexcept
     {
-        auto implementation = atomic_load (& implementation_);
-
-        return implementation->size ();
+        return read (
+            [] (const implementation_type & implementation)
+            {
+                return implementation.size ();
+            }
+        );
     }
 
     template <class InputIterator>
     void insert (InputIterator first, InputIterator last)
     {
-        auto expected = atomic_load (& implementation_);
-        shared_ptr <implementation_type> desired;
-        do
+        modify (
+            [&] (implementation_type & desired)
+            {
+                desired.insert (first, last);
+                return true;
+            }
+        );
+    }
+
+    //
+    // Similar to std::map emplace, try_emplace and insert_or_assign.
+    // Difference: Unlike std::map these functions do not return an iterator.
+    // They return whether the element was inserted.
+    // The mapped is constructed once, before the write, and moved into the
+    // clone. It is not copied, however many times the write is retried.
+    // try_emplace constructs the mapped only if key is not in the map when
+    // it is called.
+    //
+    template <typename... Args>
+    bool emplace (Args && ... args)
+    {
+        value_type value (std::forward <Args> (args)...);
+        mapped_type mapped (std::move (value.second));
+
+        return move_in (value.first, mapped, false);
+    }
+
+    template <typename... Args>
+    bool try_emplace (const key_type & key, Args && ... args)
+    {
+        if (has_key (key))
         {
-            // clone implementation_type by copy construction.
-            desired = std::make_shared <implementation_type> (* expected);
+            return false;
+        }
 
-            desired->insert (first, last);
-        } while ( !
-            atomic_compare_exchange_weak (
-                & implementation_, & expected, desired
-            )
+        mapped_type mapped (std::forward <Args> (args)...);
+
+        return move_in (key, mapped, false);
+    }
+
+    template <typename M>
+    bool insert_or_assign (const key_type & key, M && obj)
+    {
+        mapped_type mapped (std::forward <M> (obj));
+
+        return move_in (key, mapped, true);
+    }
+
+    //
+    // Atomic read-modify-write of the mapped of key, ie
+    //      m[key] = fn (m[key]);
+    // done in a single clone and compare exchange, so that no other write
+    // to the map can come in between the read and the write.
+    // fn is called with the current mapped, or a value initialized one if
+    // key is not in the map, and returns the new mapped. It is called again
+    // on every retry of the write, so it should have no side effects.
+    // Returns the new mapped.
+    //
+    template <typename Function>
+    mapped_type update (const key_type & key, Function fn)
+    {
+        mapped_type updated {};
+
+        modify (
+            [&] (implementation_type & desired)
+            {
+                mapped_type & mapped = desired[key];
+                updated = fn (static_cast <const mapped_type &> (mapped));
+                mapped = updated;
+                return true;
+            }
+        );
+
+        return updated;
+    }
+
+    //
+    // Returns the mapped of key. If key is not in the map, maps it to the
+    // result of factory() first, atomically with the check.
+    // If key is in the map when this is called, it is only read, so no
+    // clone is made. Otherwise factory may be called more than once if the
+    // write is retried, and not at all if another writer inserts key first.
+    //
+    template <typename Factory>
+    mapped_type compute_if_absent (const key_type & key, Factory factory)
+    {
+        mapped_type mapped {};
+        if (try_get (key, mapped))
+        {
+            return mapped;
+        }
+
+        modify (
+            [&] (implementation_type & desired)
+            {
+                auto itr = desired.find (key);
+                if (itr != desired.end ())
+                {
+                    mapped = itr->second;
+                    return false;
+                }
+
+                mapped = factory ();
+                desired[key] = mapped;
+                return true;
+            }
+        );
+
+        return mapped;
+    }
+
+    //
+    // Maps key to desired only if key is in the map, mapped to expected.
+    // Returns whether it was, ie whether desired was set.
+    //
+    bool compare_and_set (
+        const key_type & key,
+        const mapped_type & expected,
+        const mapped_type & desired
+    )
+    {
+        // has_value check is for efficiency only, like has_key in erase.
+        if (! has_value (key, expected))
+        {
+            return false;
+        }
+
+        bool set = false;
+
+        modify (
+            [&] (implementation_type & clone)
+            {
+                auto itr = clone.find (key);
+                set = itr != clone.end () && itr->second == expected;
+                if (set)
+                {
+                    clone[key] = desired;
+                }
+                return set;
+            }
         );
+
+        return set;
     }
 
     size_type erase (const key_type & key)
@@ -271,18 +861,12 @@ public:
         // It doesn't have to be atomic with erase itself.
         if (has_key (key))
         {
-            auto expected = atomic_load (& implementation_);
-            shared_ptr <implementation_type> desired;
-            do
-            {
-                // clone implementation_type by copy construction.
-                desired = std::make_shared <implementation_type> (* expected);
-
-                count = desired->erase (key);
-            } while ( !
-                atomic_compare_exchange_weak (
-                    & implementation_, & expected, desired
-                )
+            modify (
+                [&] (implementation_type & desired)
+                {
+                    count = desired.erase (key);
+                    return count != 0;
+                }
             );
         }
 
@@ -295,40 +879,166 @@ public:
     //
     void clear ()
     {
-        auto implementation = std::make_shared <implementation_type> ();
+        auto implementation = make_implementation ();
 
         atomic_store (& implementation_, implementation);
     }
 
     //
-    // const_iterator holds a reference to the Implementation inside the
-    // iterator to guarantee lifetime of the Implementation object.
+    // Only for an implementation that supports compaction, eg delta_map.
+    // The compacted copy of the current implementation is made before the
+    // write, so the write only rebases the current implementation onto it.
+    // See delta_map.h
     //
-    class const_iterator : public implementation_type::const_iterator
+    void compact ()
     {
-    private:
-        const_iterator (
-            typename implementation_type::const_iterator && base,
-            const shared_ptr <const implementation_type> & implementation
-        ) :
-            implementation_type::const_iterator {std::move (base)},
-            implementation_ {implementation}
+        shared_ptr <const implementation_type> current = (
+            atomic_load (& implementation_)
+        );
+        if (current->delta_size () == 0)
         {
+            return;
         }
 
-        shared_ptr <const implementation_type> implementation_;
-
-        friend container_type;
-    };
-
-    const_iterator begin () const noexcept
-    {
-        auto implementation = atomic_load (& implementation_);
+        auto compacted = current->compacted ();
 
-        return const_iterator {implementation->cbegin (), implementation};
+        modify (
+            [&] (implementation_type & desired)
+            {
+                return desired.rebase (* current, compacted);
+            }
+        );
     }
 
-    const_iterator end () const noexcept
+    //
+    // A transaction stages a sequence of writes which commit() applies to a
+    // single clone of the implementation, published with a single compare
+    // exchange. This is far cheaper than the same writes done one by one,
+    // each of which clones the whole implementation.
+    // A transaction is not thread safe by itself. It is meant to be filled
+    // by one thread and then committed, possibly more than once.
+    //
+    class transaction
+    {
+    public:
+        //
+        // Stage insertion of key mapped to mapped.
+        // Similar to std::map insert(value); no effect if key exists.
+        //
+        void insert (const key_type & key, const mapped_type & mapped)
+        {
+            staged_.push_back (staged {operation::insert, key, mapped});
+        }
+
+        //
+        // Stage mapping of key to mapped.
+        // Similar to std::map statement map[key] = mapped;
+        //
+        void assign (const key_type & key, const mapped_type & mapped)
+        {
+            staged_.push_back (staged {operation::assign, key, mapped});
+        }
+
+        //
+        // Stage erase of key.
+        //
+        void erase (const key_type & key)
+        {
+            staged_.push_back (staged {operation::erase, key, mapped_type {}});
+        }
+
+        bool empty () const noexcept
+        {
+            return staged_.empty ();
+        }
+
+        size_type size () const noexcept
+        {
+            return staged_.size ();
+        }
+
+        void clear () noexcept
+        {
+            staged_.clear ();
+        }
+
+    private:
+        enum class operation
+        {
+            insert,
+            assign,
+            erase
+        };
+
+        struct staged
+        {
+            operation op;
+            key_type key;
+            mapped_type mapped;
+        };
+
+        std::vector <staged> staged_;
+
+        friend container_type;
+    };
+
+    //
+    // Apply all the writes staged in a transaction atomically, in the order
+    // they were staged.
+    // Returns the number of keys whose element actually changed, counting
+    // each key once, however many writes to it were staged. Writes to a key
+    // that cancel out, eg assign then erase of a key that is not in the
+    // map, change nothing. If no key changed, nothing is published.
+    //
+    size_type commit (const transaction & t)
+    {
+        size_type changed = 0;
+
+        if (t.empty ())
+        {
+            return changed;
+        }
+
+        modify (
+            [&] (implementation_type & desired)
+            {
+                changed = apply (desired, t);
+                return changed != 0;
+            }
+        );
+
+        return changed;
+    }
+
+    //
+    // const_iterator holds a reference to the Implementation inside the
+    // iterator to guarantee lifetime of the Implementation object.
+    //
+    class const_iterator : public implementation_type::const_iterator
+    {
+    private:
+        const_iterator (
+            typename implementation_type::const_iterator && base,
+            const shared_ptr <const implementation_type> & implementation
+        ) :
+            implementation_type::const_iterator {std::move (base)},
+            implementation_ {implementation}
+        {
+        }
+
+        shared_ptr <const implementation_type> implementation_;
+
+        friend container_type;
+    };
+
+    const_iterator begin () const noexcept
+    {
+        auto implementation = atomic_load (& implementation_);
+
+        return const_iterator {implementation->cbegin (), implementation};
+    }
+
+    const_iterator end () const noexcept
     {
         auto implementation = atomic_load (& implementation_);
 
@@ -351,6 +1061,8 @@ public:
 
     const_iterator find (const key_type & key) const
     {
+        timed op {stats_, false};
+
         // note: specify type as const explicitly here to make sure
         // the const version of find() gets called next.
         shared_ptr <const implementation_type> implementation = (
@@ -363,6 +1075,8 @@ public:
     std::pair<const_iterator,const_iterator>
     equal_range (const key_type & key) const
     {
+        timed op {stats_, false};
+
         // note: specify type as const explicitly here to make sure
         // the const version of equal_range() gets called next.
         shared_ptr <const implementation_type> implementation = (
@@ -377,25 +1091,250 @@ public:
         );
     }
 
-    allocator_type get_allocator () const noexcept
+    //
+    // Similar to std::map lower_bound and upper_bound.
+    // Only for an ordered implementation, eg std::map or btree_map.
+    // Like find, the returned const_iterator holds on to the version of the
+    // map it was found in, so it can be incremented through a range however
+    // many writes are published meanwhile. To scan a range without holding
+    // an iterator, use for_each_in_range.
+    //
+    const_iterator lower_bound (const key_type & key) const
     {
-        auto implementation = atomic_load (& implementation_);
+        timed op {stats_, false};
+
+        shared_ptr <const implementation_type> implementation = (
+            atomic_load (& implementation_)
+        );
 
-        return implementation->get_allocator ();
+        return const_iterator {
+            implementation->lower_bound (key), implementation
+        };
     }
 
-    size_type count (const key_type & key) const
+    const_iterator upper_bound (const key_type & key) const
     {
-        auto implementation = atomic_load (& implementation_);
+        timed op {stats_, false};
+
+        shared_ptr <const implementation_type> implementation = (
+            atomic_load (& implementation_)
+        );
 
-        return implementation->count (key);
+        return const_iterator {
+            implementation->upper_bound (key), implementation
+        };
     }
 
-    size_type max_size () const noexcept
+    //
+    // Not in std::map.
+    // Invoke fn on each element with a key in [lo, hi), in key order, all of
+    // one version of the map. fn is passed the reference of the
+    // implementation iterator, snapshot_type::const_iterator::reference,
+    // which for flat_map and file_map is a pair of references rather than
+    // a const value_type &. So take it as that type, or as const auto & in
+    // C++14, eg
+    //      m.for_each_in_range (lo, hi, [&] (const auto & item) {...});
+    // A fn of const value_type & would be passed a copy of every element.
+    // Returns the number of elements visited, 0 if hi is not after lo.
+    // Only for an ordered implementation. The range is read in one read of
+    // the map, like at(key), and is stepped through with plain
+    // implementation iterators, so a scan costs no reference count per
+    // element. fn must not write to the map, nor let a reference to an
+    // element escape.
+    //
+    template <typename Function>
+    size_type for_each_in_range (
+        const key_type & lo,
+        const key_type & hi,
+        Function && fn
+    ) const
     {
-        auto implementation = atomic_load (& implementation_);
+        return read (
+            [&] (const implementation_type & implementation)
+            {
+                size_type visited = 0;
+                if (! implementation.key_comp () (lo, hi))
+                {
+                    return visited;
+                }
+
+                auto last = implementation.lower_bound (hi);
+                for (
+                    auto itr = implementation.lower_bound (lo);
+                    itr != last;
+                    ++ itr
+                )
+                {
+                    fn (* itr);
+                    ++ visited;
+                }
 
-        return implementation->max_size ();
+                return visited;
+            }
+        );
+    }
+
+    //
+    // A read-only view of the map pinned to one implementation.
+    // All reads through a view see the same version of the map, however
+    // many writes are published meanwhile, and cost no atomic operation on
+    // the map. The pin is taken once, by snapshot().
+    // Unlike the members of the map, members of a view return references and
+    // plain implementation iterators, which are valid as long as the view.
+    // A view holds on to its version of the map, so do not keep views
+    // longer than needed.
+    //
+    class snapshot_type
+    {
+    public:
+        using const_iterator = typename implementation_type::const_iterator;
+
+        //
+        // A default constructed view pins nothing. It may only be assigned
+        // to.
+        //
+        snapshot_type () = default;
+
+        const mapped_type & at (const key_type & key) const
+        {
+            return implementation_->at (key);
+        }
+
+        const_iterator find (const key_type & key) const
+        {
+            return implementation_->find (key);
+        }
+
+        size_type count (const key_type & key) const
+        {
+            return implementation_->count (key);
+        }
+
+        std::pair <const_iterator, const_iterator>
+        equal_range (const key_type & key) const
+        {
+            return implementation_->equal_range (key);
+        }
+
+        const_iterator lower_bound (const key_type & key) const
+        {
+            return implementation_->lower_bound (key);
+        }
+
+        const_iterator upper_bound (const key_type & key) const
+        {
+            return implementation_->upper_bound (key);
+        }
+
+        const_iterator begin () const noexcept
+        {
+            return implementation_->cbegin ();
+        }
+
+        const_iterator end () const noexcept
+        {
+            return implementation_->cend ();
+        }
+
+        const_iterator cbegin () const noexcept
+        {
+            return implementation_->cbegin ();
+        }
+
+        const_iterator cend () const noexcept
+        {
+            return implementation_->cend ();
+        }
+
+        bool empty () const noexcept
+        {
+            return implementation_->empty ();
+        }
+
+        size_type size () const noexcept
+        {
+            return implementation_->size ();
+        }
+
+        size_type max_size () const noexcept
+        {
+            return implementation_->max_size ();
+        }
+
+        allocator_type get_allocator () const noexcept
+        {
+            return implementation_->get_allocator ();
+        }
+
+        //
+        // The pinned implementation itself, for its members not forwarded
+        // above.
+        //
+        const implementation_type & implementation () const noexcept
+        {
+            return * implementation_;
+        }
+
+    private:
+        explicit snapshot_type (
+            shared_ptr <const implementation_type> && implementation
+        ) : implementation_ {std::move (implementation)}
+        {
+        }
+
+        shared_ptr <const implementation_type> implementation_;
+
+        friend container_type;
+    };
+
+    //
+    // Not in std::map.
+    // Counters and latency histograms of the operations on this map, if
+    // its policy records them. Lock-free, and writes nothing.
+    // begin, end, cbegin and cend are not counted as reads, since a loop
+    // may call end once per element. Retries and escalations of writes are
+    // counted here too, and only if the policy records stats.
+    //
+    map_stats stats () const noexcept
+    {
+        return stats_.read_out ();
+    }
+
+    snapshot_type snapshot () const
+    {
+        timed op {stats_, false};
+
+        return snapshot_type {atomic_load (& implementation_)};
+    }
+
+    allocator_type get_allocator () const noexcept
+    {
+        return read (
+            [] (const implementation_type & implementation)
+            {
+                return implementation.get_allocator ();
+            }
+        );
+    }
+
+    size_type count (const key_type & key) const
+    {
+        return read (
+            [&] (const implementation_type & implementation)
+            {
+                return implementation.count (key);
+            }
+        );
+    }
+
+    size_type max_size () const noexcept
+    {
+        return read (
+            [] (const implementation_type & implementation)
+            {
+                return implementation.max_size ();
+            }
+        );
     }
 
 protected:
@@ -411,15 +1350,18 @@ protected:
     //
     bool has_key (const key_type & key) const noexcept
     {
-        auto implementation = atomic_load (& implementation_);
-
-        auto itr = implementation->find (key);
-        if (itr != implementation->end ())
-        {
-            return true;
-        }
-
-        return false;
+        return read (
+            [&] (const implementation_type & implementation)
+            {
+                auto itr = implementation.find (key);
+                if (itr != implementation.end ())
+                {
+                    return true;
+                }
+
+                return false;
+            }
+        );
     }
 
     //
@@ -431,15 +1373,18 @@ protected:
         const mapped_type & mapped
     ) const noexcept
     {
-        auto implementation = atomic_load (& implementation_);
-
-        auto itr = implementation->find (key);
-        if (itr != implementation->end ())
-        {
-            return itr->second == mapped ? true : false;
-        }
-
-        return false;
+        return read (
+            [&] (const implementation_type & implementation)
+            {
+                auto itr = implementation.find (key);
+                if (itr != implementation.end ())
+                {
+                    return itr->second == mapped ? true : false;
+                }
+
+                return false;
+            }
+        );
     }
 
     //
@@ -453,25 +1398,16 @@ protected:
     {
         mapped_type mapped;
 
-        // at() invocation is for efficiency only.
-        try
+        // try_get() invocation is for efficiency only.
+        // A miss does not throw, unlike at().
+        if (! try_get (key, mapped))
         {
-            mapped = at (key);
-        }
-        catch (const std::out_of_range &)
-        {
-            auto expected = atomic_load (& implementation_);
-            shared_ptr <implementation_type> desired;
-            do
-            {
-                // clone implementation_type by copy construction.
-                desired = std::make_shared <implementation_type> (* expected);
-
-                mapped = (* desired) [key];
-            } while ( !
-                atomic_compare_exchange_weak (
-                    & implementation_, & expected, desired
-                )
+            modify (
+                [&] (implementation_type & desired)
+                {
+                    mapped = desired [key];
+                    return true;
+                }
             );
         }
 
@@ -491,28 +1427,732 @@ protected:
         // It doesn't have to be atomic with setting value.
         if (! has_value(key, mapped))
         {
-            auto expected = atomic_load (& implementation_);
-            shared_ptr <implementation_type> desired;
-            do
+            modify (
+                [&] (implementation_type & desired)
+                {
+                    desired [key] = mapped;
+                    return true;
+                }
+            );
+        }
+    }
+
+    //
+    // Like set_mapped above, but moves mapped into the map.
+    //
+    void set_mapped (const key_type & key, mapped_type && mapped)
+    {
+        if (! has_value (key, mapped))
+        {
+            move_in (key, mapped, true);
+        }
+    }
+
+private:
+    template <typename... Args>
+    shared_ptr <implementation_type> make_implementation (Args && ... args)
+    {
+        auto implementation = policy_type::template make_implementation <
+            implementation_type
+        > (std::forward <Args> (args)...);
+
+        if (! stats_type::enabled)
+        {
+            return implementation;
+        }
+
+        // count the version alive for as long as the returned pointer.
+        return shared_ptr <implementation_type> {
+            implementation.get (),
+            counted_version {implementation, stats_.version_made ()}
+        };
+    }
+
+    //
+    // Deleter of a version counted by the stats.
+    //
+    struct counted_version
+    {
+        void operator () (implementation_type *)
+        {
+            implementation.reset ();
+            freed.reset ();
+        }
+
+        shared_ptr <implementation_type> implementation;
+        shared_ptr <void> freed;
+    };
+
+    shared_ptr <implementation_type> clone (const implementation_type & from)
+    {
+        if (stats_type::enabled)
+        {
+            auto cost = clone_cost (from, 0);
+            stats_.clone (cost.first, cost.second);
+        }
+
+        return make_implementation (from);
+    }
+
+    //
+    // An implementation whose copy construction copies less than all its
+    // elements, eg one that shares nodes with the copy, has a member
+    // clone_cost () const, which returns the elements and bytes copied.
+    // See hamt_map.h. Otherwise every element is taken to be copied.
+    //
+    template <typename I>
+    static auto clone_cost (const I & from, int)
+        -> decltype (from.clone_cost ())
+    {
+        return from.clone_cost ();
+    }
+
+    template <typename I>
+    static std::pair <size_type, std::size_t> clone_cost (const I & from, long)
+    {
+        return std::make_pair (
+            from.size (), from.size () * sizeof (value_type)
+        );
+    }
+
+    //
+    // Times an operation for the stats, from construction to destruction.
+    //
+    class timed
+    {
+    public:
+        timed (stats_type & stats, bool write) :
+            stats_ (stats), write_ {write}, started_ (stats.start ())
+        {
+        }
+
+        ~timed ()
+        {
+            if (write_)
+            {
+                stats_.write (started_);
+            }
+            else
+            {
+                stats_.read (started_);
+            }
+        }
+
+        timed (const timed &) = delete;
+        timed & operator = (const timed &) = delete;
+
+    private:
+        stats_type & stats_;
+        bool write_;
+        typename stats_type::timer started_;
+    };
+
+    //
+    // Move mapped into the map as the mapped of key, if key is not in the
+    // map or assign is true. Returns whether key was inserted.
+    // mapped is moved into the clone, and moved back out of a clone that
+    // is not published, so that it is never copied.
+    //
+    bool move_in (const key_type & key, mapped_type & mapped, bool assign)
+    {
+        bool inserted = false;
+        bool moved = false;
+
+        modify (
+            [&] (implementation_type & desired)
+            {
+                inserted = desired.count (key) == 0;
+                if (! inserted && ! assign)
+                {
+                    return false;
+                }
+
+                desired [key] = std::move (mapped);
+                moved = true;
+                return true;
+            },
+            [&] (implementation_type & rejected)
+            {
+                if (moved)
+                {
+                    mapped = std::move (rejected [key]);
+                    moved = false;
+                }
+            }
+        );
+
+        return inserted;
+    }
+
+    //
+    // Invoke reader, a callable (const implementation_type &), on the
+    // current implementation and return its result.
+    // reader must not let a reference into the implementation escape, since
+    // the implementation may be freed once read returns.
+    //
+    template <typename Reader>
+    auto read (Reader && reader) const
+        -> decltype (reader (std::declval <const implementation_type &> ()))
+    {
+        timed op {stats_, false};
+
+        return atomic_read (& implementation_, std::forward <Reader> (reader));
+    }
+
+    //
+    // The implementation of the sorted range [first, last). See from_sorted.
+    // The overloads are ranked by their last parameter, int first.
+    //
+    template <class InputIterator>
+    static auto build_sorted (InputIterator first, InputIterator last, int)
+        -> decltype (implementation_type (sorted_unique, first, last))
+    {
+        return implementation_type (sorted_unique, first, last);
+    }
+
+    template <class InputIterator, class I = implementation_type>
+    static auto build_sorted (InputIterator first, InputIterator last, long)
+        -> decltype (
+            std::declval <I &> ().emplace_hint (
+                std::declval <I &> ().end (), * first
+            ),
+            I ()
+        )
+    {
+        I implementation;
+        reserve (implementation, first, last, 0);
+
+        for (; first != last; ++ first)
+        {
+            implementation.emplace_hint (implementation.end (), * first);
+        }
+
+        return implementation;
+    }
+
+    template <class InputIterator>
+    static implementation_type build_sorted (
+        InputIterator first,
+        InputIterator last,
+        ...
+    )
+    {
+        implementation_type implementation;
+        reserve (implementation, first, last, 0);
+        implementation.insert (first, last);
+
+        return implementation;
+    }
+
+    //
+    // Reserve room for [first, last) in an implementation that has reserve,
+    // if the range can be measured without consuming it.
+    //
+    template <class I, class Iterator>
+    static auto reserve (
+        I & implementation,
+        Iterator first,
+        Iterator last,
+        int
+    ) -> typename std::enable_if <
+        std::is_base_of <
+            std::forward_iterator_tag,
+            typename std::iterator_traits <Iterator>::iterator_category
+        >::value,
+        decltype (implementation.reserve (size_type {}))
+    >::type
+    {
+        implementation.reserve (
+            static_cast <size_type> (std::distance (first, last))
+        );
+    }
+
+    template <class I, class Iterator>
+    static void reserve (I &, Iterator, Iterator, long)
+    {
+    }
+
+    //
+    // Invoke found, a callable void (const_iterator), with the result of
+    // implementation.find for each key of [first, last), in order.
+    // Keys are taken in groups of prefetch_group. All keys of a group are
+    // prefetched, then all of them are found. So the first probes of a
+    // group miss the cache together, rather than one after the other.
+    //
+    static constexpr std::size_t prefetch_group = 16;
+
+    template <typename KeyIterator, typename Found>
+    static void find_each (
+        const implementation_type & implementation,
+        KeyIterator first,
+        KeyIterator last,
+        Found && found
+    )
+    {
+        while (first != last)
+        {
+            auto group_last = first;
+            for (
+                std::size_t i = 0;
+                i < prefetch_group && group_last != last;
+                ++ i, ++ group_last
+            )
+            {
+                prefetch (implementation, * group_last, 0);
+            }
+
+            for (; first != group_last; ++ first)
+            {
+                found (implementation.find (* first));
+            }
+        }
+    }
+
+    //
+    // An implementation may have a member prefetch (key) const, which
+    // prefetches the memory that find (key) reads first. See swiss_map.h.
+    // Otherwise, eg for std::unordered_map whose buckets are not exposed,
+    // nothing is prefetched.
+    //
+    template <typename I>
+    static auto prefetch (const I & implementation, const key_type & key, int)
+        -> decltype (implementation.prefetch (key), void ())
+    {
+        implementation.prefetch (key);
+    }
+
+    template <typename I>
+    static void prefetch (const I &, const key_type &, long)
+    {
+    }
+
+    //
+    // Publish a write.
+    // modifier is a callable bool (implementation_type &) which applies the
+    // write to an unpublished clone of the implementation, and returns
+    // whether it changed the clone. A clone that is not changed is not
+    // published.
+    // modifier may be invoked more than once, each time on a clone of a
+    // newer implementation, so it must not depend on side effects of its
+    // earlier invocations.
+    //
+    template <typename Modifier>
+    void modify (Modifier && modifier)
+    {
+        modify (modifier, [] (implementation_type &) {});
+    }
+
+    //
+    // recover is a callable void (implementation_type &) invoked on a clone
+    // that modifier has changed but that is not published, before the
+    // clone is thrown away. A modifier that moves a value into the clone
+    // can move it back out for its next invocation.
+    //
+    template <typename Modifier, typename Recover>
+    void modify (Modifier && modifier, Recover && recover)
+    {
+        timed op {stats_, true};
+
+        if (policy_type::combining_writes)
+        {
+            combine (modifier, recover);
+        }
+        else
+        {
+            publish (modifier, recover);
+        }
+    }
+
+    //
+    // Clone, apply modifier to the clone, and compare exchange the clone in.
+    // Retried on a clone of the newer implementation until compare exchange
+    // succeeds.
+    //
+    template <typename Modifier, typename Recover>
+    void publish (Modifier & modifier, Recover & recover)
+    {
+        escalation escalated {this};
+
+        auto expected = atomic_load (& implementation_);
+        for (unsigned attempt = 1; ; ++ attempt)
+        {
+            if (! escalated.escalated)
             {
-                // clone implementation_type by copy construction.
-                desired = std::make_shared <implementation_type> (* expected);
+                wait_for_escalated ();
+            }
 
-                (* desired) [key] = mapped;
-            } while ( !
+            // clone implementation_type by copy construction.
+            auto desired = clone (* expected);
+
+            if (
+                ! modifier (* desired) ||
                 atomic_compare_exchange_weak (
                     & implementation_, & expected, desired
                 )
-            );
+            )
+            {
+                return;
+            }
+
+            recover (* desired);
+
+            stats_.cas_failure (true);
+            if (
+                policy_type::max_retries != 0 &&
+                attempt >= policy_type::max_retries &&
+                ! escalated.escalated
+            )
+            {
+                escalated.escalate ();
+            }
+            else
+            {
+                policy_type::backoff (attempt);
+            }
         }
     }
 
-private:
+    //
+    // An escalated write of publish(), if any. Ends with publish().
+    //
+    struct escalation
+    {
+        explicit escalation (this_type * owner) : owner {owner}
+        {
+        }
+
+        void escalate ()
+        {
+            escalated = true;
+            owner->escalated_.fetch_add (1, std::memory_order_acq_rel);
+            owner->stats_.escalation ();
+        }
+
+        ~escalation ()
+        {
+            if (escalated)
+            {
+                owner->escalated_.fetch_sub (1, std::memory_order_release);
+            }
+        }
+
+        this_type * owner;
+        bool escalated = false;
+    };
+
+    void wait_for_escalated ()
+    {
+        if (policy_type::max_retries == 0)
+        {
+            return;
+        }
+
+        while (escalated_.load (std::memory_order_acquire) != 0)
+        {
+            std::this_thread::yield ();
+        }
+    }
+
+    //
+    // A write posted to the publication list of a combining map.
+    // It lives on the stack of the posting writer until done is set.
+    //
+    struct publication
+    {
+        publication * next;
+        publication * previous;
+        void * modifier;
+        bool (* apply) (void * modifier, implementation_type & desired);
+        void * recover;
+        void (* restore) (void * recover, implementation_type & rejected);
+        std::exception_ptr error;
+        std::atomic <bool> done;
+    };
+
+    template <typename Modifier>
+    static bool apply_modifier (void * modifier, implementation_type & desired)
+    {
+        return (* static_cast <Modifier *> (modifier)) (desired);
+    }
+
+    template <typename Recover>
+    static void apply_recover (void * recover, implementation_type & rejected)
+    {
+        (* static_cast <Recover *> (recover)) (rejected);
+    }
+
+    //
+    // Post a write to the publication list and wait until it is published,
+    // either by this writer as the combiner or by some other combiner.
+    // Rethrows only what modifier threw, or what the combiner threw while
+    // cloning for it.
+    //
+    template <typename Modifier, typename Recover>
+    void combine (Modifier & modifier, Recover & recover)
+    {
+        publication p;
+        p.previous = nullptr;
+        p.modifier = & modifier;
+        p.apply = & apply_modifier <Modifier>;
+        p.recover = & recover;
+        p.restore = & apply_recover <Recover>;
+        p.done.store (false, std::memory_order_relaxed);
+
+        p.next = pending_.load (std::memory_order_relaxed);
+        while ( !
+            pending_.compare_exchange_weak (
+                p.next, & p, std::memory_order_release
+            )
+        );
+
+        while (! p.done.load (std::memory_order_acquire))
+        {
+            if (! combining_.exchange (true, std::memory_order_acquire))
+            {
+                combine_pending ();
+                combining_.store (false, std::memory_order_release);
+            }
+            else
+            {
+                std::this_thread::yield ();
+            }
+        }
+
+        if (p.error)
+        {
+            std::rethrow_exception (p.error);
+        }
+    }
+
+    //
+    // Apply all posted writes to a single clone and publish it.
+    // A write that throws is left out: the clone it may have half modified
+    // is thrown away, and the other writes are applied to a new clone.
+    // Only invoked by the combiner.
+    //
+    void combine_pending ()
+    {
+        auto head = pending_.exchange (nullptr, std::memory_order_acquire);
+        if (! head)
+        {
+            return;
+        }
+
+        // the publication list is a stack. Reverse it to apply the writes in
+        // the order they were posted.
+        publication * posted = nullptr;
+        while (head)
+        {
+            auto next = head->next;
+            head->next = posted;
+            if (posted)
+            {
+                posted->previous = head;
+            }
+            posted = head;
+            head = next;
+        }
+
+        std::exception_ptr error;
+        try
+        {
+            auto expected = atomic_load (& implementation_);
+            for (;;)
+            {
+                auto desired = clone (* expected);
+                bool changed = false;
+                publication * failed = nullptr;
+                for (auto p = posted; p && ! failed; p = p->next)
+                {
+                    if (p->error)
+                    {
+                        continue;
+                    }
+
+                    try
+                    {
+                        changed = p->apply (p->modifier, * desired) || changed;
+                    }
+                    catch (...)
+                    {
+                        p->error = std::current_exception ();
+                        failed = p;
+                    }
+                }
+
+                if (! failed)
+                {
+                    // Only stores of a whole implementation, eg by clear(),
+                    // compete with the combiner. If one wins, the batch is
+                    // taken to have been published right before that store,
+                    // and overwritten by it. So the batch is not retried,
+                    // and its writes are applied once.
+                    if (
+                        changed &&
+                        ! atomic_compare_exchange_weak (
+                            & implementation_, & expected, desired
+                        )
+                    )
+                    {
+                        stats_.cas_failure (false);
+                    }
+                    break;
+                }
+
+                // recover the writes applied before failed, latest first,
+                // so that each gets back what it moved into the clone.
+                for (auto p = failed->previous; p; p = p->previous)
+                {
+                    if (! p->error)
+                    {
+                        p->restore (p->recover, * desired);
+                    }
+                }
+            }
+        }
+        catch (...)
+        {
+            error = std::current_exception ();
+        }
+
+        while (posted)
+        {
+            // read next before done is set, since a publication is gone
+            // once its writer sees done.
+            auto next = posted->next;
+            if (! posted->error)
+            {
+                posted->error = error;
+            }
+            posted->done.store (true, std::memory_order_release);
+            posted = next;
+        }
+    }
+
+    //
+    // apply the writes staged in a transaction to an unpublished
+    // implementation. Returns the number of keys that changed in it.
+    //
+    static size_type apply (
+        implementation_type & implementation,
+        const transaction & t
+    )
+    {
+        using operation = typename transaction::operation;
+
+        // what the staged writes make of the element of each key, decided
+        // before any of them is applied.
+        struct outcome
+        {
+            typename implementation_type::const_iterator before;
+            bool present;
+
+            // the staged mapped of the element after, or null if it is the
+            // element before.
+            const mapped_type * mapped;
+        };
+
+        const implementation_type & view = implementation;
+        typename key_pointer_map <implementation_type, outcome>::type
+            outcomes;
+        for (const auto & s : t.staged_)
+        {
+            auto itr = outcomes.find (& s.key);
+            if (itr == outcomes.end ())
+            {
+                auto before = view.find (s.key);
+                itr = outcomes.insert (
+                    std::make_pair (
+                        & s.key,
+                        outcome {before, before != view.end (), nullptr}
+                    )
+                ).first;
+            }
+
+            auto & o = itr->second;
+            switch (s.op)
+            {
+            case operation::insert:
+                if (! o.present)
+                {
+                    o.present = true;
+                    o.mapped = & s.mapped;
+                }
+                break;
+            case operation::assign:
+                o.present = true;
+                o.mapped = & s.mapped;
+                break;
+            case operation::erase:
+                o.present = false;
+                o.mapped = nullptr;
+                break;
+            }
+        }
+
+        // compare each key, once, with its element before.
+        size_type changed = 0;
+        for (const auto & key_outcome : outcomes)
+        {
+            const auto & o = key_outcome.second;
+            bool was_present = o.before != view.end ();
+            if (
+                o.present != was_present ||
+                (o.mapped && ! (* o.mapped == o.before->second))
+            )
+            {
+                ++ changed;
+            }
+        }
+
+        for (const auto & s : t.staged_)
+        {
+            switch (s.op)
+            {
+            case operation::insert:
+                implementation.insert (value_type {s.key, s.mapped});
+                break;
+            case operation::assign:
+                {
+                    auto itr = implementation.find (s.key);
+                    if (
+                        itr == implementation.end () ||
+                        ! (itr->second == s.mapped)
+                    )
+                    {
+                        implementation [s.key] = s.mapped;
+                    }
+                    break;
+                }
+            case operation::erase:
+                implementation.erase (s.key);
+                break;
+            }
+        }
+
+        return changed;
+    }
+
     //
     // private data members.
     //
 
-    shared_ptr <implementation_type> implementation_;
+    // lock-free, unlike std::atomic_load etc. of a shared_ptr.
+    typename policy_type::template snapshot_ptr <implementation_type>
+        implementation_;
+
+    //
+    // publication list and combiner flag of a combining map.
+    //
+    std::atomic <publication *> pending_ {nullptr};
+    std::atomic <bool> combining_ {false};
+
+    //
+    // contention of writes that are not combined.
+    //
+    std::atomic <unsigned> escalated_ {0};
+
+    mutable stats_type stats_;
 };
 
 template <
@@ -0,0 +1,494 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Lock-free map sharded over independent lockfree::map_templates.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "map.h"
+
+/*
+Notes:
+1.  A write to a map_template clones the whole map and compare exchanges
+    the one pointer to it. sharded_map_template hashes keys over a number of
+    independent map_templates, its shards, so a write clones only the
+    shard of its key, and contends only with writers to the same shard.
+2.  The shard count is set at construction and fixed for the lifetime of
+    the map.
+3.  Members that read a single key, eg at and count, read a single shard.
+    Members that read every shard, eg size and iteration, read the shards
+    one after another, not at one instant, so they may see a write to one
+    shard and not an earlier write to another. snapshot() pins every shard
+    at one instant, for reads that must be consistent across shards.
+4.  There is no find or equal_range, since the iterator they return would
+    have to pin every shard. Use at or count, or find of a snapshot.
+5.  Keys are hashed with ShardHash for shards of both ordered and unordered
+    maps, so keys of a sharded ordered map must be hashable too. Iteration
+    is ordered within a shard only.
+*/
+
+namespace lockfree
+{
+
+template <
+    typename Implementation,
+    typename Policy = default_policy,
+    typename ShardHash = std::hash <typename Implementation::key_type>
+>
+class sharded_map_template
+{
+public:
+    using shard_type = map_template <Implementation, Policy>;
+    using implementation_type = Implementation;
+    using policy_type = Policy;
+    using key_type = typename shard_type::key_type;
+    using mapped_type = typename shard_type::mapped_type;
+    using value_type = typename shard_type::value_type;
+    using size_type = typename shard_type::size_type;
+    using shard_hasher = ShardHash;
+    using reference_to_mapped = typename shard_type::reference_to_mapped;
+
+    static constexpr size_type default_shard_count = 16;
+
+private:
+    using shard_snapshot = typename shard_type::snapshot_type;
+    using shard_snapshots = std::vector <shard_snapshot>;
+
+public:
+    //
+    // Iterates the shards in order, and each shard from its begin to its
+    // end. Holds on to the versions of the shards it iterates.
+    //
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename sharded_map_template::value_type;
+        using difference_type = std::ptrdiff_t;
+        using inner_iterator = typename shard_snapshot::const_iterator;
+        using pointer = typename std::iterator_traits <
+            inner_iterator
+        >::pointer;
+        using reference = typename std::iterator_traits <
+            inner_iterator
+        >::reference;
+
+        const_iterator () = default;
+
+        reference operator * () const
+        {
+            return * itr_;
+        }
+
+        pointer operator -> () const
+        {
+            return itr_.operator -> ();
+        }
+
+        const_iterator & operator ++ ()
+        {
+            ++ itr_;
+            skip_empty ();
+            return * this;
+        }
+
+        const_iterator operator ++ (int)
+        {
+            auto itr = * this;
+            ++ (* this);
+            return itr;
+        }
+
+        bool operator == (const const_iterator & other) const
+        {
+            return (
+                snapshots_ == other.snapshots_ &&
+                (! snapshots_ || (
+                    shard_ == other.shard_ && itr_ == other.itr_
+                ))
+            );
+        }
+
+        bool operator != (const const_iterator & other) const
+        {
+            return ! (* this == other);
+        }
+
+    private:
+        explicit const_iterator (
+            std::shared_ptr <const shard_snapshots> snapshots
+        ) :
+            snapshots_ {std::move (snapshots)},
+            itr_ {(* snapshots_) [0].begin ()}
+        {
+            skip_empty ();
+        }
+
+        const_iterator (
+            std::shared_ptr <const shard_snapshots> snapshots,
+            std::size_t shard,
+            inner_iterator && itr
+        ) :
+            snapshots_ {std::move (snapshots)},
+            shard_ {shard},
+            itr_ {std::move (itr)}
+        {
+        }
+
+        //
+        // Move on to the next shard that is not empty once at the end of a
+        // shard. Past the last shard, the iterator is the end iterator.
+        //
+        void skip_empty ()
+        {
+            while (itr_ == (* snapshots_) [shard_].end ())
+            {
+                if (++ shard_ == snapshots_->size ())
+                {
+                    * this = const_iterator {};
+                    return;
+                }
+                itr_ = (* snapshots_) [shard_].begin ();
+            }
+        }
+
+        // null for the end iterator.
+        std::shared_ptr <const shard_snapshots> snapshots_;
+        std::size_t shard_ = 0;
+        inner_iterator itr_;
+
+        friend sharded_map_template;
+    };
+
+    //
+    // A read-only view of all shards, pinned to versions of the shards
+    // that were all current at one instant.
+    //
+    class snapshot_type
+    {
+    public:
+        using const_iterator = typename sharded_map_template::const_iterator;
+
+        const mapped_type & at (const key_type & key) const
+        {
+            return shard (key).at (key);
+        }
+
+        size_type count (const key_type & key) const
+        {
+            return shard (key).count (key);
+        }
+
+        const_iterator find (const key_type & key) const
+        {
+            auto i = shard_index (hash_, snapshots_->size (), key);
+            auto itr = (* snapshots_) [i].find (key);
+            if (itr == (* snapshots_) [i].end ())
+            {
+                return end ();
+            }
+
+            return const_iterator {snapshots_, i, std::move (itr)};
+        }
+
+        const shard_snapshot & shard (const key_type & key) const
+        {
+            return (* snapshots_) [
+                shard_index (hash_, snapshots_->size (), key)
+            ];
+        }
+
+        const_iterator begin () const
+        {
+            return const_iterator {snapshots_};
+        }
+
+        const_iterator end () const noexcept
+        {
+            return const_iterator {};
+        }
+
+        bool empty () const noexcept
+        {
+            return size () == 0;
+        }
+
+        size_type size () const noexcept
+        {
+            size_type size = 0;
+            for (const auto & s : * snapshots_)
+            {
+                size += s.size ();
+            }
+
+            return size;
+        }
+
+    private:
+        snapshot_type (
+            const shard_hasher & hash,
+            std::shared_ptr <const shard_snapshots> snapshots
+        ) : hash_ {hash}, snapshots_ {std::move (snapshots)}
+        {
+        }
+
+        // a copy of the hasher of the map, so that a snapshot does not
+        // refer to the map, and may outlive it.
+        shard_hasher hash_;
+        std::shared_ptr <const shard_snapshots> snapshots_;
+
+        friend sharded_map_template;
+    };
+
+    explicit sharded_map_template (
+        size_type shard_count = default_shard_count,
+        const shard_hasher & hash = shard_hasher {}
+    ) :
+        shards_ (shard_count == 0 ? 1 : shard_count),
+        hash_ {hash}
+    {
+    }
+
+    sharded_map_template (const sharded_map_template &) = delete;
+    sharded_map_template & operator = (const sharded_map_template &) = delete;
+
+    size_type shard_count () const noexcept
+    {
+        return shards_.size ();
+    }
+
+    //
+    // The shard that holds key.
+    //
+    shard_type & shard (const key_type & key)
+    {
+        return shards_ [shard_index (key)].map;
+    }
+
+    const shard_type & shard (const key_type & key) const
+    {
+        return shards_ [shard_index (key)].map;
+    }
+
+    mapped_type at (const key_type & key) const
+    {
+        return shard (key).at (key);
+    }
+
+    size_type count (const key_type & key) const
+    {
+        return shard (key).count (key);
+    }
+
+    typename shard_type::pinned_mapped pin (const key_type & key) const
+    {
+        return shard (key).pin (key);
+    }
+
+    reference_to_mapped operator [] (const key_type & key)
+    {
+        return shard (key) [key];
+    }
+
+    //
+    // Inserts into each shard with one write.
+    //
+    template <class InputIterator>
+    void insert (InputIterator first, InputIterator last)
+    {
+        std::vector <std::vector <value_type>> values (shards_.size ());
+        for (; first != last; ++ first)
+        {
+            const value_type & value = * first;
+            values [shard_index (value.first)].push_back (value);
+        }
+
+        for (std::size_t i = 0; i < shards_.size (); ++ i)
+        {
+            if (! values [i].empty ())
+            {
+                shards_ [i].map.insert (values [i].begin (), values [i].end ());
+            }
+        }
+    }
+
+    size_type erase (const key_type & key)
+    {
+        return shard (key).erase (key);
+    }
+
+    //
+    // Clears the shards one after another.
+    //
+    void clear ()
+    {
+        for (auto & s : shards_)
+        {
+            s.map.clear ();
+        }
+    }
+
+    bool empty () const noexcept
+    {
+        for (const auto & s : shards_)
+        {
+            if (! s.map.empty ())
+            {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    size_type size () const noexcept
+    {
+        size_type size = 0;
+        for (const auto & s : shards_)
+        {
+            size += s.map.size ();
+        }
+
+        return size;
+    }
+
+    //
+    // Pins every shard, one after another, and iterates them.
+    //
+    const_iterator begin () const
+    {
+        return const_iterator {collect ()};
+    }
+
+    const_iterator end () const noexcept
+    {
+        return const_iterator {};
+    }
+
+    const_iterator cbegin () const
+    {
+        return begin ();
+    }
+
+    const_iterator cend () const noexcept
+    {
+        return end ();
+    }
+
+    //
+    // Double collect: pin every shard, then check that no shard has been
+    // written since it was pinned. If none has, all the pinned versions
+    // were current at the instant the check started. Otherwise retry.
+    // Writers never wait for a snapshot, so a snapshot may retry as long as
+    // writes keep coming.
+    //
+    snapshot_type snapshot () const
+    {
+        for (;;)
+        {
+            auto snapshots = collect ();
+
+            bool unchanged = true;
+            for (std::size_t i = 0; unchanged && i < shards_.size (); ++ i)
+            {
+                // a pinned version cannot be freed, so its address cannot be
+                // reused by a newer version.
+                unchanged = (
+                    & shards_ [i].map.snapshot ().implementation () ==
+                    & (* snapshots) [i].implementation ()
+                );
+            }
+
+            if (unchanged)
+            {
+                return snapshot_type {hash_, std::move (snapshots)};
+            }
+        }
+    }
+
+private:
+    //
+    // A shard padded so that the atomic pointers of different shards do
+    // not share a cache line.
+    //
+    struct padded_shard
+    {
+        shard_type map;
+        char padding [64];
+    };
+
+    std::size_t shard_index (const key_type & key) const
+    {
+        return shard_index (hash_, shards_.size (), key);
+    }
+
+    static std::size_t shard_index (
+        const shard_hasher & hash,
+        std::size_t shard_count,
+        const key_type & key
+    )
+    {
+        // mix the hash, since std::hash of integers is typically the
+        // identity and keys are often strided.
+        std::uint64_t h = hash (key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        return static_cast <std::size_t> (h % shard_count);
+    }
+
+    std::shared_ptr <const shard_snapshots> collect () const
+    {
+        auto snapshots = std::make_shared <shard_snapshots> ();
+        snapshots->reserve (shards_.size ());
+        for (const auto & s : shards_)
+        {
+            snapshots->push_back (s.map.snapshot ());
+        }
+
+        return snapshots;
+    }
+
+    std::vector <padded_shard> shards_;
+    shard_hasher hash_;
+};
+
+template <
+    typename Key,
+    typename Mapped,
+    typename Predicate = std::less <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using sharded_map = sharded_map_template <
+    std::map <Key, Mapped, Predicate, Allocator>
+>;
+
+template <
+    typename Key,
+    typename Mapped,
+    typename Hash = std::hash <Key>,
+    typename Predicate = std::equal_to <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using sharded_unordered_map = sharded_map_template <
+    std::unordered_map <Key, Mapped, Hash, Predicate, Allocator>,
+    default_policy,
+    Hash
+>;
+
+}
@@ -0,0 +1,461 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Map whose elements are immutable cells shared by all its copies, for
+//      use as the Implementation of lockfree::map_template.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <unordered_map>
+#include <utility>
+
+#include "map.h"
+
+/*
+Notes:
+1.  The clone of every lockfree write copies every element of the map, and
+    for keys and mapped values such as strings, copying their payloads
+    costs far more than copying the map. shared_cells keeps each element in
+    a reference counted cell, and an index of pointers to the cells. Copy
+    construction copies the index only, so all copies share the cells, and
+    the cost of a clone depends on the number of elements, not on their
+    size.
+2.  Implementation, eg a std::map or a std::unordered_map, selects the key,
+    the mapped, the ordering or hashing, and the allocator. The index is a
+    std::map for an Implementation with a key_compare, else a
+    std::unordered_map.
+3.  A cell is never changed once a copy shares it. A write to the mapped of
+    an existing key replaces its cell with a new one, so a write copies the
+    payload of the element it writes and no other.
+4.  The index refers to the key in the cell, so a lookup neither copies
+    nor allocates a key.
+5.  Every write invalidates all iterators, pointers and references to
+    elements, like std::vector does. A reference to an element stays valid
+    as long as any copy that shares its cell, eg a pinned snapshot.
+*/
+
+namespace lockfree
+{
+
+template <typename T>
+struct cells_void
+{
+    using type = void;
+};
+
+//
+// Reference to the key in a cell, ie the key of the index.
+//
+template <typename Key>
+struct cell_key
+{
+    const Key * key;
+};
+
+//
+// Index from the keys of cells to the cells, with the same ordering or
+// hashing as Implementation.
+//
+template <typename Implementation, typename Cell, typename = void>
+struct cells_index
+{
+    using key_type = typename Implementation::key_type;
+
+    struct hash : private Implementation::hasher
+    {
+        std::size_t operator () (const cell_key <key_type> & k) const
+        {
+            return Implementation::hasher::operator () (* k.key);
+        }
+    };
+
+    struct equal : private Implementation::key_equal
+    {
+        bool operator () (
+            const cell_key <key_type> & a,
+            const cell_key <key_type> & b
+        ) const
+        {
+            return Implementation::key_equal::operator () (* a.key, * b.key);
+        }
+    };
+
+    using value_type = std::pair <const cell_key <key_type>, Cell>;
+    using type = std::unordered_map <
+        cell_key <key_type>,
+        Cell,
+        hash,
+        equal,
+        typename std::allocator_traits <
+            typename Implementation::allocator_type
+        >::template rebind_alloc <value_type>
+    >;
+};
+
+template <typename Implementation, typename Cell>
+struct cells_index <
+    Implementation,
+    Cell,
+    typename cells_void <typename Implementation::key_compare>::type
+>
+{
+    using key_type = typename Implementation::key_type;
+
+    struct compare : private Implementation::key_compare
+    {
+        bool operator () (
+            const cell_key <key_type> & a,
+            const cell_key <key_type> & b
+        ) const
+        {
+            return Implementation::key_compare::operator () (* a.key, * b.key);
+        }
+    };
+
+    using value_type = std::pair <const cell_key <key_type>, Cell>;
+    using type = std::map <
+        cell_key <key_type>,
+        Cell,
+        compare,
+        typename std::allocator_traits <
+            typename Implementation::allocator_type
+        >::template rebind_alloc <value_type>
+    >;
+};
+
+template <typename Implementation>
+class shared_cells : public key_functions <Implementation>
+{
+public:
+    using key_type = typename Implementation::key_type;
+    using mapped_type = typename Implementation::mapped_type;
+    using value_type = typename Implementation::value_type;
+    using size_type = typename Implementation::size_type;
+    using difference_type = typename Implementation::difference_type;
+    using allocator_type = typename Implementation::allocator_type;
+
+private:
+    // mutable only while this shared_cells is its only owner.
+    using cell_ptr = shared_ptr <value_type>;
+    using index_type = typename cells_index <
+        Implementation, cell_ptr
+    >::type;
+    using index_iterator = typename index_type::const_iterator;
+
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename shared_cells::value_type;
+        using difference_type = typename shared_cells::difference_type;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+
+        const_iterator () = default;
+
+        reference operator * () const
+        {
+            return * itr_->second;
+        }
+
+        pointer operator -> () const
+        {
+            return itr_->second.get ();
+        }
+
+        const_iterator & operator ++ ()
+        {
+            ++ itr_;
+            return * this;
+        }
+
+        const_iterator operator ++ (int)
+        {
+            auto itr = * this;
+            ++ (* this);
+            return itr;
+        }
+
+        bool operator == (const const_iterator & other) const
+        {
+            return itr_ == other.itr_;
+        }
+
+        bool operator != (const const_iterator & other) const
+        {
+            return ! (* this == other);
+        }
+
+    private:
+        explicit const_iterator (index_iterator itr) : itr_ {itr}
+        {
+        }
+
+        index_iterator itr_;
+
+        friend shared_cells;
+    };
+
+    // all elements are immutable through an iterator, as in std::set.
+    using iterator = const_iterator;
+
+    shared_cells () = default;
+
+    explicit shared_cells (const allocator_type & allocator) :
+        allocator_ {allocator}
+    {
+    }
+
+    shared_cells (std::initializer_list <value_type> init)
+    {
+        insert (init.begin (), init.end ());
+    }
+
+    template <class InputIterator>
+    shared_cells (InputIterator first, InputIterator last)
+    {
+        insert (first, last);
+    }
+
+    //
+    // Copy construction copies the index, and shares every cell.
+    //
+    shared_cells (const shared_cells & other) = default;
+    shared_cells (shared_cells && other) = default;
+    shared_cells & operator = (const shared_cells & other) = default;
+    shared_cells & operator = (shared_cells && other) = default;
+
+    const_iterator begin () const noexcept
+    {
+        return const_iterator {index_.cbegin ()};
+    }
+
+    const_iterator end () const noexcept
+    {
+        return const_iterator {index_.cend ()};
+    }
+
+    const_iterator cbegin () const noexcept
+    {
+        return begin ();
+    }
+
+    const_iterator cend () const noexcept
+    {
+        return end ();
+    }
+
+    bool empty () const noexcept
+    {
+        return index_.empty ();
+    }
+
+    size_type size () const noexcept
+    {
+        return index_.size ();
+    }
+
+    //
+    // Elements and bytes copied by copy construction, for the stats of a
+    // map_template. Only the index is copied, not the cells.
+    //
+    std::pair <size_type, std::size_t> clone_cost () const noexcept
+    {
+        return std::make_pair (
+            index_.size (),
+            index_.size () * sizeof (typename index_type::value_type)
+        );
+    }
+
+    size_type max_size () const noexcept
+    {
+        return index_.max_size ();
+    }
+
+    allocator_type get_allocator () const noexcept
+    {
+        return allocator_;
+    }
+
+    const_iterator find (const key_type & key) const
+    {
+        return const_iterator {index_.find (cell_key <key_type> {& key})};
+    }
+
+    size_type count (const key_type & key) const
+    {
+        return index_.count (cell_key <key_type> {& key});
+    }
+
+    const mapped_type & at (const key_type & key) const
+    {
+        auto itr = index_.find (cell_key <key_type> {& key});
+        if (itr == index_.cend ())
+        {
+            throw std::out_of_range {"shared_cells::at"};
+        }
+
+        return itr->second->second;
+    }
+
+    std::pair <const_iterator, const_iterator>
+    equal_range (const key_type & key) const
+    {
+        auto first = find (key);
+        auto last = first;
+        if (last != end ())
+        {
+            ++ last;
+        }
+
+        return std::make_pair (first, last);
+    }
+
+    //
+    // Returned reference is valid until the next write to this
+    // shared_cells. The cell of key is replaced by a copy first, unless no
+    // other copy shares it.
+    //
+    mapped_type & operator [] (const key_type & key)
+    {
+        auto itr = index_.find (cell_key <key_type> {& key});
+        if (itr == index_.end ())
+        {
+            return insert_cell (key, mapped_type {})->second->second;
+        }
+
+        // a cell reachable from this shared_cells alone cannot be shared
+        // meanwhile, since this shared_cells is not yet published.
+        if (itr->second.use_count () == 1)
+        {
+            // pairs with the release by the last other owner when it let go,
+            // so its reads of the cell happen before our writes.
+            std::atomic_thread_fence (std::memory_order_acquire);
+        }
+        else
+        {
+            auto cell = make_cell (* itr->second);
+
+            // the key of the index refers to the old cell, so replace the
+            // entry rather than only its cell.
+            itr = index_.erase (itr);
+            itr = index_.insert (
+                itr,
+                std::make_pair (cell_key <key_type> {& cell->first}, cell)
+            );
+        }
+
+        return itr->second->second;
+    }
+
+    std::pair <iterator, bool> insert (const value_type & value)
+    {
+        auto itr = index_.find (cell_key <key_type> {& value.first});
+        if (itr != index_.end ())
+        {
+            return std::make_pair (const_iterator {itr}, false);
+        }
+
+        return std::make_pair (
+            const_iterator {insert_cell (value.first, value.second)},
+            true
+        );
+    }
+
+    template <class InputIterator>
+    void insert (InputIterator first, InputIterator last)
+    {
+        for (; first != last; ++ first)
+        {
+            insert (* first);
+        }
+    }
+
+    size_type erase (const key_type & key)
+    {
+        return index_.erase (cell_key <key_type> {& key});
+    }
+
+    void clear () noexcept
+    {
+        index_.clear ();
+    }
+
+    //
+    // Whether the element of key is in the same cell in this and other,
+    // ie it has not been written since they were copied.
+    //
+    bool shares_cell (const shared_cells & other, const key_type & key) const
+    {
+        auto itr = index_.find (cell_key <key_type> {& key});
+        auto other_itr = other.index_.find (cell_key <key_type> {& key});
+        return (
+            itr != index_.cend () &&
+            other_itr != other.index_.cend () &&
+            itr->second == other_itr->second
+        );
+    }
+
+private:
+    template <typename... Args>
+    cell_ptr make_cell (Args && ... args)
+    {
+        return std::allocate_shared <value_type> (
+            allocator_, std::forward <Args> (args)...
+        );
+    }
+
+    typename index_type::iterator insert_cell (
+        const key_type & key,
+        const mapped_type & mapped
+    )
+    {
+        auto cell = make_cell (key, mapped);
+        return index_.insert (
+            std::make_pair (cell_key <key_type> {& cell->first}, cell)
+        ).first;
+    }
+
+    index_type index_;
+    allocator_type allocator_;
+};
+
+//
+// lockfree::map whose clones copy pointers to the elements, not the
+// elements. For keys or mapped values that are costly to copy.
+//
+template <
+    typename Key,
+    typename Mapped,
+    typename Predicate = std::less <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using shared_cells_map = map_template <
+    shared_cells <std::map <Key, Mapped, Predicate, Allocator>>
+>;
+
+template <
+    typename Key,
+    typename Mapped,
+    typename Hash = std::hash <Key>,
+    typename Predicate = std::equal_to <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using shared_cells_unordered_map = map_template <
+    shared_cells <std::unordered_map <Key, Mapped, Hash, Predicate, Allocator>>
+>;
+
+}
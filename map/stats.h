@@ -0,0 +1,295 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Operation counters and latency histograms of lockfree::map_template.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+/*
+Notes:
+1.  A policy selects the stats of a map_template with its stats_type.
+    no_stats, the default, records nothing and compiles to nothing.
+    sharded_stats records every operation.
+2.  sharded_stats keeps its counters in shards padded to separate cache
+    lines, and each thread counts in a shard of its own, so threads that
+    count do not contend. A count is a relaxed fetch_add.
+3.  Reading the stats sums the shards with relaxed loads. It is lock-free
+    and writes nothing, so it does not disturb the map. Since the shards
+    are read one after another, the sums are not of one instant.
+4.  Latencies are counted in histograms of log2 buckets of nanoseconds.
+    Each timed operation reads the steady clock twice.
+*/
+
+namespace lockfree
+{
+
+//
+// Stats of a map, as read out by map_template::stats().
+//
+struct map_stats
+{
+    static constexpr std::size_t latency_buckets = 64;
+
+    // bucket i counts operations that took [2^(i-1), 2^i) nanoseconds.
+    // Bucket 0 counts operations that took no measurable time.
+    using histogram = std::array <std::uint64_t, latency_buckets>;
+
+    std::uint64_t reads = 0;
+    std::uint64_t writes = 0;
+
+    // failed compare exchanges of writes, and the ones that were retried.
+    std::uint64_t cas_failures = 0;
+    std::uint64_t retries = 0;
+
+    // writes that escalated after max_retries retries. See default_policy.
+    std::uint64_t escalations = 0;
+
+    // clones of the implementation, and the elements and bytes they
+    // copied. Bytes are sizeof (value_type) per element, and do not include
+    // memory that elements own, eg the characters of a string.
+    // An implementation that shares its elements with its copies reports
+    // what its copy construction copies instead. See map_template::clone.
+    std::uint64_t clones = 0;
+    std::uint64_t entries_copied = 0;
+    std::uint64_t bytes_copied = 0;
+
+    // versions of the implementation not yet freed, ie the current one and
+    // the ones held by snapshots, iterators and readers.
+    std::int64_t snapshots_alive = 0;
+
+    histogram read_latency {};
+    histogram write_latency {};
+};
+
+//
+// Records nothing.
+//
+class no_stats
+{
+public:
+    static constexpr bool enabled = false;
+
+    struct timer
+    {
+    };
+
+    timer start () const noexcept
+    {
+        return timer {};
+    }
+
+    void read (const timer &) noexcept {}
+    void write (const timer &) noexcept {}
+    void cas_failure (bool) noexcept {}
+    void escalation () noexcept {}
+    void clone (std::size_t, std::size_t) noexcept {}
+
+    //
+    // Whatever must live as long as a version, to count it freed.
+    //
+    std::shared_ptr <void> version_made () noexcept
+    {
+        return nullptr;
+    }
+
+    map_stats read_out () const noexcept
+    {
+        return map_stats {};
+    }
+};
+
+class sharded_stats
+{
+public:
+    static constexpr bool enabled = true;
+    static constexpr std::size_t shard_count = 16;
+
+    using clock = std::chrono::steady_clock;
+    using timer = clock::time_point;
+
+    sharded_stats () : alive_ {std::make_shared <alive_count> ()}
+    {
+    }
+
+    sharded_stats (const sharded_stats &) = delete;
+    sharded_stats & operator = (const sharded_stats &) = delete;
+
+    timer start () const noexcept
+    {
+        return clock::now ();
+    }
+
+    void read (const timer & started) noexcept
+    {
+        auto & s = local_shard ();
+        count (s.counters [reads]);
+        count (s.read_latency [bucket (started)]);
+    }
+
+    void write (const timer & started) noexcept
+    {
+        auto & s = local_shard ();
+        count (s.counters [writes]);
+        count (s.write_latency [bucket (started)]);
+    }
+
+    void cas_failure (bool retried) noexcept
+    {
+        auto & s = local_shard ();
+        count (s.counters [cas_failures]);
+        if (retried)
+        {
+            count (s.counters [retries]);
+        }
+    }
+
+    void escalation () noexcept
+    {
+        count (local_shard ().counters [escalations]);
+    }
+
+    void clone (std::size_t entries, std::size_t bytes) noexcept
+    {
+        auto & s = local_shard ();
+        count (s.counters [clones]);
+        count (s.counters [entries_copied], entries);
+        count (s.counters [bytes_copied], bytes);
+    }
+
+    //
+    // Counts a version made, and returns what counts it freed once
+    // destroyed. It may outlive this sharded_stats, like the version.
+    //
+    std::shared_ptr <void> version_made ()
+    {
+        alive_->count.fetch_add (1, std::memory_order_relaxed);
+        return std::shared_ptr <void> {
+            nullptr, version_freed {alive_}
+        };
+    }
+
+    map_stats read_out () const noexcept
+    {
+        map_stats stats;
+        for (const auto & s : shards_)
+        {
+            stats.reads += load (s.counters [reads]);
+            stats.writes += load (s.counters [writes]);
+            stats.cas_failures += load (s.counters [cas_failures]);
+            stats.retries += load (s.counters [retries]);
+            stats.escalations += load (s.counters [escalations]);
+            stats.clones += load (s.counters [clones]);
+            stats.entries_copied += load (s.counters [entries_copied]);
+            stats.bytes_copied += load (s.counters [bytes_copied]);
+            for (std::size_t i = 0; i < map_stats::latency_buckets; ++ i)
+            {
+                stats.read_latency [i] += load (s.read_latency [i]);
+                stats.write_latency [i] += load (s.write_latency [i]);
+            }
+        }
+        stats.snapshots_alive = alive_->count.load (std::memory_order_relaxed);
+
+        return stats;
+    }
+
+private:
+    using counter = std::atomic <std::uint64_t>;
+
+    enum
+    {
+        reads,
+        writes,
+        cas_failures,
+        retries,
+        escalations,
+        clones,
+        entries_copied,
+        bytes_copied,
+        counter_count
+    };
+
+    //
+    // Padded so that shards do not share a cache line.
+    //
+    struct shard
+    {
+        counter counters [counter_count] {};
+        counter read_latency [map_stats::latency_buckets] {};
+        counter write_latency [map_stats::latency_buckets] {};
+        char padding [64];
+    };
+
+    struct alive_count
+    {
+        std::atomic <std::int64_t> count {0};
+    };
+
+    struct version_freed
+    {
+        void operator () (void *) const noexcept
+        {
+            alive->count.fetch_sub (1, std::memory_order_relaxed);
+        }
+
+        std::shared_ptr <alive_count> alive;
+    };
+
+    static void count (counter & c, std::uint64_t n = 1) noexcept
+    {
+        c.fetch_add (n, std::memory_order_relaxed);
+    }
+
+    static std::uint64_t load (const counter & c) noexcept
+    {
+        return c.load (std::memory_order_relaxed);
+    }
+
+    //
+    // log2 bucket of the nanoseconds since started.
+    //
+    static std::size_t bucket (const timer & started) noexcept
+    {
+        auto ns = std::chrono::duration_cast <std::chrono::nanoseconds> (
+            clock::now () - started
+        ).count ();
+        std::uint64_t n = ns > 0 ? static_cast <std::uint64_t> (ns) : 0;
+
+        std::size_t bucket = 0;
+        while (n != 0 && bucket + 1 < map_stats::latency_buckets)
+        {
+            n >>= 1;
+            ++ bucket;
+        }
+
+        return bucket;
+    }
+
+    //
+    // Threads take shards round robin, on first use.
+    //
+    shard & local_shard () noexcept
+    {
+        static std::atomic <std::size_t> next {0};
+        static thread_local std::size_t index = (
+            next.fetch_add (1, std::memory_order_relaxed) % shard_count
+        );
+
+        return shards_ [index];
+    }
+
+    shard shards_ [shard_count];
+    std::shared_ptr <alive_count> alive_;
+};
+
+}
@@ -0,0 +1,837 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Open addressing hash table with SIMD probing, for use as the
+//      Implementation of lockfree::map_template.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <initializer_list>
+#include <iterator>
+#include <limits>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+
+#if defined (__SSE2__) || defined (_M_X64) || \
+    (defined (_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define LOCKFREE_SWISS_MAP_SSE2
+#endif
+
+#include "map.h"
+
+/*
+Notes:
+1.  swiss_map is an unordered map with the interface of std::unordered_map
+    that map_template needs. It is an open addressing hash table in the
+    style of the swiss tables of abseil. The elements are held in place in
+    an array of slots, with no per element allocation.
+2.  Every slot has a control byte, which is empty, deleted, or for a full
+    slot the low 7 bits of the hash of its key. The control bytes of a
+    group of 16 slots are compared with the 7 bits of a key in one SSE2
+    instruction, so a probe checks 16 slots at once, and only compares keys
+    of slots whose 7 bits match. A lookup typically touches the cache line
+    of its control bytes and the cache line of its slot.
+    Without SSE2, a group is compared byte by byte.
+3.  The control bytes and the slots are in one allocation. Copy
+    construction, ie the clone of every lockfree write, is one allocation
+    and, for trivially copyable keys and mapped values, one memcpy.
+4.  The table grows by doubling once 7/8 of the slots are full or deleted.
+5.  Every write invalidates all iterators, pointers and references to
+    elements, like std::vector does.
+*/
+
+namespace lockfree
+{
+
+template <
+    typename Key,
+    typename Mapped,
+    typename Hash = std::hash <Key>,
+    typename Predicate = std::equal_to <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+class swiss_map
+{
+public:
+    using key_type = Key;
+    using mapped_type = Mapped;
+    using value_type = std::pair <const Key, Mapped>;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using hasher = Hash;
+    using key_equal = Predicate;
+    using allocator_type = Allocator;
+    using reference = value_type &;
+    using const_reference = const value_type &;
+
+private:
+    using ctrl_type = std::int8_t;
+    using slot_type =
+        typename std::aligned_storage <
+            sizeof (value_type), alignof (value_type)
+        >::type;
+    using slot_allocator = typename std::allocator_traits <
+        allocator_type
+    >::template rebind_alloc <slot_type>;
+
+    static constexpr ctrl_type ctrl_empty = -128;
+    static constexpr ctrl_type ctrl_deleted = -2;
+    static constexpr std::size_t group_width = 16;
+
+    static constexpr bool trivially_copyable = (
+        std::is_trivially_copyable <key_type>::value &&
+        std::is_trivially_copyable <mapped_type>::value
+    );
+
+    //
+    // The control bytes of group_width slots, as bit masks of the slots
+    // that match.
+    //
+    class group
+    {
+    public:
+        explicit group (const ctrl_type * ctrl)
+#ifdef LOCKFREE_SWISS_MAP_SSE2
+            : ctrl_ {
+                _mm_loadu_si128 (reinterpret_cast <const __m128i *> (ctrl))
+            }
+#else
+            : ctrl_ {ctrl}
+#endif
+        {
+        }
+
+        // full slots whose control byte is h2.
+        std::uint32_t match (ctrl_type h2) const
+        {
+#ifdef LOCKFREE_SWISS_MAP_SSE2
+            return static_cast <std::uint32_t> (
+                _mm_movemask_epi8 (_mm_cmpeq_epi8 (_mm_set1_epi8 (h2), ctrl_))
+            );
+#else
+            std::uint32_t mask = 0;
+            for (std::size_t i = 0; i < group_width; ++ i)
+            {
+                mask |= std::uint32_t {ctrl_ [i] == h2} << i;
+            }
+            return mask;
+#endif
+        }
+
+        std::uint32_t match_empty () const
+        {
+            return match (ctrl_empty);
+        }
+
+        // only the control bytes of empty and deleted slots are negative.
+        std::uint32_t match_empty_or_deleted () const
+        {
+#ifdef LOCKFREE_SWISS_MAP_SSE2
+            return static_cast <std::uint32_t> (_mm_movemask_epi8 (ctrl_));
+#else
+            std::uint32_t mask = 0;
+            for (std::size_t i = 0; i < group_width; ++ i)
+            {
+                mask |= std::uint32_t {ctrl_ [i] < 0} << i;
+            }
+            return mask;
+#endif
+        }
+
+    private:
+#ifdef LOCKFREE_SWISS_MAP_SSE2
+        __m128i ctrl_;
+#else
+        const ctrl_type * ctrl_;
+#endif
+    };
+
+public:
+    class const_iterator
+    {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = typename swiss_map::value_type;
+        using difference_type = typename swiss_map::difference_type;
+        using pointer = const value_type *;
+        using reference = const value_type &;
+
+        const_iterator () = default;
+
+        reference operator * () const
+        {
+            return * reinterpret_cast <const value_type *> (slot_);
+        }
+
+        pointer operator -> () const
+        {
+            return reinterpret_cast <const value_type *> (slot_);
+        }
+
+        const_iterator & operator ++ ()
+        {
+            ++ ctrl_;
+            ++ slot_;
+            skip_free ();
+            return * this;
+        }
+
+        const_iterator operator ++ (int)
+        {
+            auto itr = * this;
+            ++ (* this);
+            return itr;
+        }
+
+        bool operator == (const const_iterator & other) const
+        {
+            return ctrl_ == other.ctrl_;
+        }
+
+        bool operator != (const const_iterator & other) const
+        {
+            return ! (* this == other);
+        }
+
+    private:
+        const_iterator (
+            const ctrl_type * ctrl,
+            const slot_type * slot,
+            const ctrl_type * end
+        ) : ctrl_ {ctrl}, slot_ {slot}, end_ {end}
+        {
+        }
+
+        void skip_free ()
+        {
+            while (ctrl_ != end_ && * ctrl_ < 0)
+            {
+                ++ ctrl_;
+                ++ slot_;
+            }
+        }
+
+        const ctrl_type * ctrl_ = nullptr;
+        const slot_type * slot_ = nullptr;
+        const ctrl_type * end_ = nullptr;
+
+        friend swiss_map;
+    };
+
+    // all elements are immutable through an iterator, as in std::set.
+    using iterator = const_iterator;
+
+    swiss_map () = default;
+
+    explicit swiss_map (
+        const hasher & hash,
+        const key_equal & equal = key_equal {},
+        const allocator_type & allocator = allocator_type {}
+    ) : hash_ {hash}, equal_ {equal}, allocator_ {allocator}
+    {
+    }
+
+    explicit swiss_map (const allocator_type & allocator) :
+        allocator_ {allocator}
+    {
+    }
+
+    swiss_map (
+        std::initializer_list <value_type> init,
+        const hasher & hash = hasher {},
+        const key_equal & equal = key_equal {},
+        const allocator_type & allocator = allocator_type {}
+    ) : hash_ {hash}, equal_ {equal}, allocator_ {allocator}
+    {
+        insert (init.begin (), init.end ());
+    }
+
+    template <class InputIterator>
+    swiss_map (
+        InputIterator first,
+        InputIterator last,
+        const hasher & hash = hasher {},
+        const key_equal & equal = key_equal {},
+        const allocator_type & allocator = allocator_type {}
+    ) : hash_ {hash}, equal_ {equal}, allocator_ {allocator}
+    {
+        insert (first, last);
+    }
+
+    //
+    // Copies the table as is, with the same capacity and the same slots, so
+    // no key is hashed.
+    //
+    swiss_map (const swiss_map & other) :
+        hash_ {other.hash_},
+        equal_ {other.equal_},
+        allocator_ {
+            std::allocator_traits <slot_allocator>::
+                select_on_container_copy_construction (other.allocator_)
+        }
+    {
+        if (other.capacity_ == 0)
+        {
+            return;
+        }
+
+        allocate (other.capacity_);
+
+        if (trivially_copyable)
+        {
+            std::memcpy (
+                block_,
+                other.block_,
+                block_size (capacity_) * sizeof (slot_type)
+            );
+        }
+        else
+        {
+            std::memcpy (ctrl_, other.ctrl_, capacity_);
+
+            std::size_t i = 0;
+            try
+            {
+                for (; i < capacity_; ++ i)
+                {
+                    if (ctrl_ [i] >= 0)
+                    {
+                        new (& slots_ [i]) value_type (other.entry (i));
+                    }
+                }
+            }
+            catch (...)
+            {
+                destroy (i);
+                deallocate ();
+                throw;
+            }
+        }
+
+        size_ = other.size_;
+        growth_left_ = other.growth_left_;
+    }
+
+    swiss_map (swiss_map && other) noexcept :
+        hash_ {std::move (other.hash_)},
+        equal_ {std::move (other.equal_)},
+        allocator_ {std::move (other.allocator_)}
+    {
+        steal (other);
+    }
+
+    swiss_map & operator = (const swiss_map & other)
+    {
+        if (this != & other)
+        {
+            swiss_map copy {other};
+            * this = std::move (copy);
+        }
+
+        return * this;
+    }
+
+    swiss_map & operator = (swiss_map && other) noexcept
+    {
+        if (this != & other)
+        {
+            destroy (capacity_);
+            deallocate ();
+
+            hash_ = std::move (other.hash_);
+            equal_ = std::move (other.equal_);
+            allocator_ = std::move (other.allocator_);
+            steal (other);
+        }
+
+        return * this;
+    }
+
+    ~swiss_map ()
+    {
+        destroy (capacity_);
+        deallocate ();
+    }
+
+    const_iterator begin () const noexcept
+    {
+        const_iterator itr {ctrl_, slots_, ctrl_ + capacity_};
+        itr.skip_free ();
+        return itr;
+    }
+
+    const_iterator end () const noexcept
+    {
+        auto end = ctrl_ + capacity_;
+        return const_iterator {end, slots_ + capacity_, end};
+    }
+
+    const_iterator cbegin () const noexcept
+    {
+        return begin ();
+    }
+
+    const_iterator cend () const noexcept
+    {
+        return end ();
+    }
+
+    bool empty () const noexcept
+    {
+        return size_ == 0;
+    }
+
+    size_type size () const noexcept
+    {
+        return size_;
+    }
+
+    size_type max_size () const noexcept
+    {
+        return std::numeric_limits <difference_type>::max () /
+            sizeof (slot_type);
+    }
+
+    allocator_type get_allocator () const noexcept
+    {
+        return allocator_type {allocator_};
+    }
+
+    hasher hash_function () const
+    {
+        return hash_;
+    }
+
+    key_equal key_eq () const
+    {
+        return equal_;
+    }
+
+    const_iterator find (const key_type & key) const
+    {
+        return iterator_at (find_index (key, hash (key)));
+    }
+
+    size_type count (const key_type & key) const
+    {
+        return find (key) == end () ? 0 : 1;
+    }
+
+    //
+    // Prefetch the control bytes and the slots of the group that find (key)
+    // probes first. See map_template::find_many.
+    //
+    void prefetch (const key_type & key) const
+    {
+        if (capacity_ == 0)
+        {
+            return;
+        }
+
+        auto base = first_group (hash (key)) * group_width;
+        prefetch_line (ctrl_ + base);
+        prefetch_line (slots_ + base);
+    }
+
+    const mapped_type & at (const key_type & key) const
+    {
+        auto i = find_index (key, hash (key));
+        if (i == capacity_)
+        {
+            throw std::out_of_range {"swiss_map::at"};
+        }
+
+        return entry (i).second;
+    }
+
+    std::pair <const_iterator, const_iterator>
+    equal_range (const key_type & key) const
+    {
+        auto first = find (key);
+        auto last = first;
+        if (last != end ())
+        {
+            ++ last;
+        }
+
+        return std::make_pair (first, last);
+    }
+
+    //
+    // Returned reference is valid until the next write to this swiss_map.
+    //
+    mapped_type & operator [] (const key_type & key)
+    {
+        return entry (
+            locate (key, [&key] () {
+                return value_type {key, mapped_type {}};
+            }).first
+        ).second;
+    }
+
+    std::pair <iterator, bool> insert (const value_type & value)
+    {
+        auto located = locate (value.first, [&value] () { return value; });
+
+        return std::make_pair (iterator_at (located.first), located.second);
+    }
+
+    template <class InputIterator>
+    void insert (InputIterator first, InputIterator last)
+    {
+        for (; first != last; ++ first)
+        {
+            insert (* first);
+        }
+    }
+
+    size_type erase (const key_type & key)
+    {
+        auto i = find_index (key, hash (key));
+        if (i == capacity_)
+        {
+            return 0;
+        }
+
+        entry (i).~value_type ();
+        -- size_;
+
+        // A probe only passes a group that has no empty slot. If the group
+        // of i has one, no probe has passed it, so i can be empty again.
+        // Otherwise i is marked deleted, so that probes still pass it.
+        if (group {ctrl_ + i / group_width * group_width}.match_empty ())
+        {
+            ctrl_ [i] = ctrl_empty;
+            ++ growth_left_;
+        }
+        else
+        {
+            ctrl_ [i] = ctrl_deleted;
+        }
+
+        return 1;
+    }
+
+    void clear () noexcept
+    {
+        destroy (capacity_);
+        deallocate ();
+    }
+
+private:
+    //
+    // std::hash of integers is typically the identity. Mix all bits of the
+    // hash into both the group index and the control byte.
+    //
+    std::size_t hash (const key_type & key) const
+    {
+        std::uint64_t h = hash_ (key);
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return static_cast <std::size_t> (h);
+    }
+
+    static ctrl_type h2 (std::size_t h)
+    {
+        return static_cast <ctrl_type> (h & 0x7f);
+    }
+
+    static void prefetch_line (const void * address)
+    {
+#if defined (__GNUC__)
+        __builtin_prefetch (address);
+#else
+        (void) address;
+#endif
+    }
+
+    static unsigned lowest_bit (std::uint32_t mask)
+    {
+#if defined (__GNUC__)
+        return static_cast <unsigned> (__builtin_ctz (mask));
+#else
+        unsigned i = 0;
+        while (! (mask & 1))
+        {
+            mask >>= 1;
+            ++ i;
+        }
+        return i;
+#endif
+    }
+
+    //
+    // Groups are probed in triangular order, (h1 + 0), (h1 + 0 + 1),
+    // (h1 + 0 + 1 + 2) ..., which visits every group of a power of 2 count
+    // of groups.
+    //
+    std::size_t first_group (std::size_t h) const
+    {
+        return (h >> 7) & (capacity_ / group_width - 1);
+    }
+
+    std::size_t next_group (std::size_t g, std::size_t step) const
+    {
+        return (g + step) & (capacity_ / group_width - 1);
+    }
+
+    //
+    // index of the slot of key, or capacity_ if there is none.
+    //
+    std::size_t find_index (const key_type & key, std::size_t h) const
+    {
+        if (capacity_ == 0)
+        {
+            return capacity_;
+        }
+
+        auto g = first_group (h);
+        for (std::size_t step = 1; ; ++ step)
+        {
+            auto base = g * group_width;
+            group grp {ctrl_ + base};
+            for (auto mask = grp.match (h2 (h)); mask; mask &= mask - 1)
+            {
+                auto i = base + lowest_bit (mask);
+                if (equal_ (entry (i).first, key))
+                {
+                    return i;
+                }
+            }
+
+            if (grp.match_empty ())
+            {
+                return capacity_;
+            }
+
+            g = next_group (g, step);
+        }
+    }
+
+    //
+    // index of the first empty or deleted slot on the probe sequence of h.
+    // There is always one, since the table is never full.
+    //
+    std::size_t free_index (std::size_t h) const
+    {
+        auto g = first_group (h);
+        for (std::size_t step = 1; ; ++ step)
+        {
+            auto base = g * group_width;
+            auto mask = group {ctrl_ + base}.match_empty_or_deleted ();
+            if (mask)
+            {
+                return base + lowest_bit (mask);
+            }
+
+            g = next_group (g, step);
+        }
+    }
+
+    //
+    // Find the slot of key. If it does not exist, insert make () in a
+    // new slot. Returns the slot and whether it was inserted.
+    //
+    template <typename Make>
+    std::pair <std::size_t, bool> locate (const key_type & key, Make make)
+    {
+        auto h = hash (key);
+        auto i = find_index (key, h);
+        if (i != capacity_)
+        {
+            return std::make_pair (i, false);
+        }
+
+        if (growth_left_ == 0)
+        {
+            // grow, unless deleted slots take up more than half the load.
+            rehash (
+                capacity_ == 0 ? group_width :
+                size_ + 1 > max_load (capacity_) / 2 ? capacity_ * 2 :
+                capacity_
+            );
+        }
+
+        i = free_index (h);
+        new (& slots_ [i]) value_type (make ());
+        if (ctrl_ [i] == ctrl_empty)
+        {
+            -- growth_left_;
+        }
+        ctrl_ [i] = h2 (h);
+        ++ size_;
+
+        return std::make_pair (i, true);
+    }
+
+    //
+    // Rebuild the table with capacity slots and no deleted slots.
+    //
+    void rehash (std::size_t capacity)
+    {
+        swiss_map rebuilt {hash_, equal_, get_allocator ()};
+        rebuilt.allocate (capacity);
+
+        for (std::size_t i = 0; i < capacity_; ++ i)
+        {
+            if (ctrl_ [i] >= 0)
+            {
+                auto h = hash (entry (i).first);
+                auto j = rebuilt.free_index (h);
+                new (& rebuilt.slots_ [j]) value_type (
+                    std::move_if_noexcept (entry (i))
+                );
+                rebuilt.ctrl_ [j] = h2 (h);
+                ++ rebuilt.size_;
+                -- rebuilt.growth_left_;
+            }
+        }
+
+        * this = std::move (rebuilt);
+    }
+
+    static std::size_t max_load (std::size_t capacity)
+    {
+        return capacity - capacity / 8;
+    }
+
+    //
+    // slots taken by the control bytes and the slots of a table.
+    //
+    static std::size_t block_size (std::size_t capacity)
+    {
+        return (capacity + sizeof (slot_type) - 1) / sizeof (slot_type) +
+            capacity;
+    }
+
+    //
+    // Allocate an empty table of capacity slots, a power of 2 multiple of
+    // group_width. The table must have none.
+    //
+    void allocate (std::size_t capacity)
+    {
+        block_ = std::allocator_traits <slot_allocator>::allocate (
+            allocator_, block_size (capacity)
+        );
+        ctrl_ = reinterpret_cast <ctrl_type *> (block_);
+        slots_ = block_ + block_size (capacity) - capacity;
+        std::memset (ctrl_, static_cast <unsigned char> (ctrl_empty), capacity);
+
+        capacity_ = capacity;
+        size_ = 0;
+        growth_left_ = max_load (capacity);
+    }
+
+    void deallocate () noexcept
+    {
+        if (block_)
+        {
+            std::allocator_traits <slot_allocator>::deallocate (
+                allocator_, block_, block_size (capacity_)
+            );
+        }
+
+        block_ = nullptr;
+        ctrl_ = nullptr;
+        slots_ = nullptr;
+        capacity_ = 0;
+        size_ = 0;
+        growth_left_ = 0;
+    }
+
+    //
+    // Destroy the elements in the slots before last.
+    //
+    void destroy (std::size_t last) noexcept
+    {
+        if (std::is_trivially_destructible <value_type>::value)
+        {
+            return;
+        }
+
+        for (std::size_t i = 0; i < last; ++ i)
+        {
+            if (ctrl_ [i] >= 0)
+            {
+                entry (i).~value_type ();
+            }
+        }
+    }
+
+    void steal (swiss_map & other) noexcept
+    {
+        block_ = other.block_;
+        ctrl_ = other.ctrl_;
+        slots_ = other.slots_;
+        capacity_ = other.capacity_;
+        size_ = other.size_;
+        growth_left_ = other.growth_left_;
+
+        other.block_ = nullptr;
+        other.ctrl_ = nullptr;
+        other.slots_ = nullptr;
+        other.capacity_ = 0;
+        other.size_ = 0;
+        other.growth_left_ = 0;
+    }
+
+    const_iterator iterator_at (std::size_t i) const
+    {
+        return const_iterator {ctrl_ + i, slots_ + i, ctrl_ + capacity_};
+    }
+
+    value_type & entry (std::size_t i)
+    {
+        return * reinterpret_cast <value_type *> (& slots_ [i]);
+    }
+
+    const value_type & entry (std::size_t i) const
+    {
+        return * reinterpret_cast <const value_type *> (& slots_ [i]);
+    }
+
+    slot_type * block_ = nullptr;
+    ctrl_type * ctrl_ = nullptr;
+    slot_type * slots_ = nullptr;
+    std::size_t capacity_ = 0;
+    size_type size_ = 0;
+
+    // slots that can still be filled before the table must grow.
+    std::size_t growth_left_ = 0;
+
+    hasher hash_;
+    key_equal equal_;
+    slot_allocator allocator_;
+};
+
+//
+// lockfree::unordered_map whose implementation is an open addressing hash
+// table, with no per element allocation on clone.
+//
+template <
+    typename Key,
+    typename Mapped,
+    typename Hash = std::hash <Key>,
+    typename Predicate = std::equal_to <Key>,
+    typename Allocator = std::allocator <std::pair <const Key, Mapped>>
+>
+using flat_unordered_map = map_template <
+    swiss_map <Key, Mapped, Hash, Predicate, Allocator>
+>;
+
+}
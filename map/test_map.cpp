@@ -2,13 +2,29 @@
 #include <algorithm>
 #include <string>
 #include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <system_error>
+#include <stdexcept>
 #include <sstream>
 #include <list>
+#include <iterator>
 #include <vector>
 #include <future>
+#include <atomic>
+#include <thread>
+#include <chrono>
 #include <random>
 
 #include "map.h"
+#include "hamt_map.h"
+#include "btree_map.h"
+#include "flat_map.h"
+#include "swiss_map.h"
+#include "sharded_map.h"
+#include "delta_map.h"
+#include "shared_cells.h"
+#include "file_map.h"
 
 using std::cout;
 
@@ -106,6 +122,59 @@ void test_read(Map &)
         PASS_M("at");
     }
 
+    // non-throwing lookups
+    int mapped = -1;
+    ASSERT_M(m1.try_get(5, mapped) && mapped == 6, "try_get");
+    ASSERT_M(!m1.try_get(9, mapped) && mapped == 6, "try_get missing");
+    ASSERT_M(m1.get_or(5, -1) == 6 && m1.get_or(9, -1) == -1, "get_or");
+#if __cplusplus >= 201703L
+    ASSERT_M(m1.try_get(5) == 6 && !m1.try_get(9), "try_get optional");
+#endif
+
+    // pinned mapped outlives later writes to its key.
+    auto pinned = m1.pin(5);
+    ASSERT_M(pinned && *pinned == 6 && !m1.pin(9), "pin");
+    m1.erase(5);
+    m1[5] = 60;
+    ASSERT_M(*pinned == 6 && *m1.pin(5) == 60, "pin after writes");
+    m1[5] = 6;
+
+    // batched lookups, over more than one prefetch group.
+    Map m2;
+    std::vector<int> keys;
+    for (int key = 0; key < 40; ++key)
+    {
+        if (key % 2 == 0)
+        {
+            m2[key] = key * 10;
+        }
+        keys.push_back(key);
+    }
+    std::vector<typename Map::pinned_mapped> pins;
+    ASSERT_M(m2.find_many(keys.begin(), keys.end(), std::back_inserter(pins))
+        == 20, "find_many count");
+    bool all = pins.size() == keys.size();
+    for (std::size_t i = 0; all && i < pins.size(); ++i)
+    {
+        all = keys[i] % 2 == 0 ?
+            pins[i] && *pins[i] == keys[i] * 10 : !pins[i];
+    }
+    ASSERT_M(all, "find_many");
+
+    std::vector<int> even{ 38, 0, 2, 36 };
+    std::vector<int> mapped_many;
+    m2.at_many(even.begin(), even.end(), std::back_inserter(mapped_many));
+    ASSERT_M(mapped_many == (std::vector<int>{ 380, 0, 20, 360 }), "at_many");
+    try
+    {
+        m2.at_many(keys.begin(), keys.end(), std::back_inserter(mapped_many));
+        FAIL_M("at_many missing");
+    }
+    catch (const std::out_of_range &)
+    {
+        PASS_M("at_many missing");
+    }
+
     // indexing
     ASSERT_M(m1[5] == 6, "indexing");
     ASSERT_M(m1[9] == 0, "indexing");
@@ -115,66 +184,1186 @@ void test_read(Map &)
     std::list<int> actual;
     for (auto item : m1)
     {
-        actual.push_back(item.first);
+        actual.push_back(item.first);
+    }
+    actual.sort();  // needed for unordered_map
+    ASSERT_M(actual == expected, "iteration");
+
+    // find
+    ASSERT_M(m1.find(5)->second == 6, "find");
+    ASSERT_M(m1.find(11) == m1.end(), "find end");
+
+    // equal_range
+    ASSERT_M(m1.equal_range(5).first->second == 6, "equal_range");
+
+    //count
+    ASSERT_M(m1.count(5) == 1, "count");
+    ASSERT_M(m1.count(11) == 0, "count");
+
+    // max_size
+    ASSERT_M(m1.max_size() > 1, "max_size");
+}
+
+template<class Map>
+void test_write(Map &)
+{
+    Map m1{
+        typename Map::implementation_type{ { 1,2 },{ 3,4 },{ 5,6 },{ 7,8 } }
+    };
+
+    // indexing
+    m1[5] = 99;
+    ASSERT_M(m1.at(5) == 99, "indexing");
+    m1[17] = 100;
+    ASSERT_M(m1.at(17) == 100, "indexing");
+
+    // insert
+    std::vector<std::pair<int, int>> v{ { 21,22 },{ 23,24 },{ 25,26 } };
+    m1.insert(v.begin(), v.end());
+    std::list<int> expected{ 1,3,5,7,17,21,23,25 };
+    std::list<int> actual;
+    for (auto item : m1)
+    {
+        actual.push_back(item.first);
+    }
+    actual.sort();  // needed for unordered_map
+    ASSERT_M(actual == expected, "insert");
+
+    m1.erase(17);
+    ASSERT_M(m1.find(17) == m1.end(), "erase");
+
+    ASSERT_M(!m1.empty(), "empty");
+    m1.clear();
+    ASSERT_M(m1.size() == 0, "clear");
+    ASSERT_M(m1.empty(), "empty");
+}
+
+template<class Map>
+void test_transaction(Map &)
+{
+    Map m1{
+        typename Map::implementation_type{ { 1,2 },{ 3,4 },{ 5,6 },{ 7,8 } }
+    };
+
+    typename Map::transaction t;
+    ASSERT_M(m1.commit(t) == 0, "empty transaction");
+
+    t.insert(1, 99);    // no change, key exists
+    t.insert(9, 10);
+    t.assign(3, 4);     // no change, same mapped
+    t.assign(5, 66);
+    t.assign(11, 12);
+    t.erase(7);
+    t.erase(13);        // no change, key absent
+    ASSERT_M(t.size() == 7, "transaction size");
+
+    ASSERT_M(m1.commit(t) == 4, "transaction changed count");
+    std::list<int> expected{ 1,3,5,9,11 };
+    std::list<int> actual;
+    for (auto item : m1)
+    {
+        actual.push_back(item.first);
+    }
+    actual.sort();  // needed for unordered_map
+    ASSERT_M(actual == expected, "transaction commit");
+    ASSERT_M(m1.at(1) == 2, "transaction insert existing");
+    ASSERT_M(m1.at(5) == 66, "transaction assign");
+
+    // committing again changes nothing.
+    ASSERT_M(m1.commit(t) == 0, "transaction recommit");
+    ASSERT_M(m1.size() == 5, "transaction recommit");
+
+    // writes to one key are netted, and cancelling writes publish nothing.
+    typename Map::transaction u;
+    u.assign(13, 14);
+    u.erase(13);
+    u.assign(1, 3);
+    u.assign(1, 2);
+    u.assign(9, 0);
+    u.assign(9, 1);
+    ASSERT_M(m1.commit(u) == 1 && m1.at(9) == 1, "transaction net changes");
+    u.clear();
+    u.assign(13, 14);
+    u.erase(13);
+    auto before = m1.snapshot();
+    ASSERT_M(m1.commit(u) == 0, "transaction no net change");
+    ASSERT_M(&m1.snapshot().implementation() == &before.implementation(),
+        "transaction no net change not published");
+}
+
+template<class Map>
+void test_read_modify_write(Map &)
+{
+    Map m1{
+        typename Map::implementation_type{ { 1,2 },{ 3,4 },{ 5,6 },{ 7,8 } }
+    };
+
+    auto increment = [](const int & mapped) { return mapped + 1; };
+    ASSERT_M(m1.update(1, increment) == 3, "update");
+    ASSERT_M(m1.at(1) == 3, "update");
+    ASSERT_M(m1.update(9, increment) == 1, "update absent");
+    ASSERT_M(m1.at(9) == 1, "update absent");
+
+    int calls = 0;
+    auto factory = [&calls]() { ++calls; return 42; };
+    ASSERT_M(m1.compute_if_absent(3, factory) == 4, "compute_if_absent");
+    ASSERT_M(calls == 0, "compute_if_absent present");
+    ASSERT_M(m1.compute_if_absent(11, factory) == 42, "compute_if_absent");
+    ASSERT_M(calls == 1 && m1.at(11) == 42, "compute_if_absent absent");
+
+    ASSERT_M(m1.compare_and_set(5, 6, 60), "compare_and_set");
+    ASSERT_M(m1.at(5) == 60, "compare_and_set");
+    ASSERT_M(!m1.compare_and_set(5, 6, 600), "compare_and_set mismatch");
+    ASSERT_M(m1.at(5) == 60, "compare_and_set mismatch");
+    ASSERT_M(!m1.compare_and_set(13, 0, 1), "compare_and_set absent");
+    ASSERT_M(m1.find(13) == m1.end(), "compare_and_set absent");
+}
+
+template<class Map>
+void test_snapshot(Map &)
+{
+    Map m1{
+        typename Map::implementation_type{ { 1,2 },{ 3,4 },{ 5,6 } }
+    };
+
+    auto view = m1.snapshot();
+    m1[1] = 22;
+    m1[7] = 8;
+
+    // the view does not see writes published after it is taken.
+    ASSERT_M(view.size() == 3, "snapshot size");
+    ASSERT_M(view.at(1) == 2, "snapshot at");
+    ASSERT_M(view.count(7) == 0, "snapshot count");
+    ASSERT_M(view.find(7) == view.end(), "snapshot find");
+    ASSERT_M(view.find(3)->second == 4, "snapshot find");
+    auto range = view.equal_range(5);
+    ASSERT_M(
+        range.first != range.second && range.first->second == 6,
+        "snapshot equal_range"
+    );
+    try
+    {
+        view.at(7);
+        FAIL_M("snapshot at exception");
+    }
+    catch (const std::out_of_range &)
+    {
+        PASS_M("snapshot at exception");
+    }
+
+    int sum = 0;
+    for (const auto & item : view)
+    {
+        sum += item.second;
+    }
+    ASSERT_M(sum == 12, "snapshot iteration");
+    ASSERT_M(
+        std::distance(view.begin(), view.end()) == 3,
+        "snapshot begin end"
+    );
+
+    ASSERT_M(m1.snapshot().at(1) == 22, "new snapshot sees writes");
+    ASSERT_M(m1.snapshot().size() == 4, "new snapshot sees writes");
+}
+
+template<class Map>
+void test_interface(Map & m)
+{
+    test_construct_assign(m);
+    test_read(m);
+    test_write(m);
+    test_transaction(m);
+    test_read_modify_write(m);
+    test_snapshot(m);
+}
+
+//
+// Test an implementation whose copies share structure.
+// Writes to a copy must not be visible in the original and vice versa.
+//
+template<class Implementation>
+void test_persistent()
+{
+    std::mt19937 mt(17);
+    std::uniform_int_distribution<int> ud(0, 4095);
+
+    Implementation imp;
+    std::map<int, int> reference;
+    for (int i = 0; i < 20000; ++i)
+    {
+        auto key = ud(mt);
+        if (i % 3 == 2)
+        {
+            if (imp.erase(key) != reference.erase(key))
+            {
+                FAIL_M("erase count");
+                return;
+            }
+        }
+        else
+        {
+            imp[key] = i;
+            reference[key] = i;
+        }
+    }
+    ASSERT_M(imp.size() == reference.size(), "size");
+
+    auto contents = [](const Implementation & imp) {
+        std::map<int, int> m;
+        for (const auto & item : imp)
+        {
+            m.insert(item);
+        }
+        return m;
+    };
+    ASSERT_M(contents(imp) == reference, "contents");
+
+    auto copy = imp;
+    for (int key = 0; key < 4096; key += 2)
+    {
+        copy.erase(key);
+        copy[key + 1] = -1;
+    }
+    ASSERT_M(contents(imp) == reference, "original unchanged by copy");
+    ASSERT_M(copy.size() == 2048, "copy changed");
+
+    std::map<int, int> copy_reference = contents(copy);
+    for (int key = 0; key < 4096; ++key)
+    {
+        imp.erase(key);
+    }
+    ASSERT_M(imp.empty() && imp.begin() == imp.end(), "original erased");
+    ASSERT_M(contents(copy) == copy_reference, "copy unchanged by original");
+}
+
+//
+// Test copies and growth of an implementation whose elements are not
+// trivially copyable.
+//
+template<class Implementation>
+void test_copy_strings()
+{
+    Implementation imp;
+    for (int i = 0; i < 1000; ++i)
+    {
+        imp[std::to_string(i)] = std::string(40, 'a' + i % 26);
+    }
+    for (int i = 0; i < 1000; i += 2)
+    {
+        imp.erase(std::to_string(i));
+    }
+
+    auto copy = imp;
+    copy.erase("1");
+    copy["1001"] = "b";
+
+    bool ok = imp.size() == 500 && copy.size() == 500;
+    for (int i = 1; i < 1000; i += 2)
+    {
+        ok = ok && imp.at(std::to_string(i))[0] == 'a' + i % 26;
+    }
+    ok = ok && imp.count("1") == 1 && imp.count("1001") == 0;
+    ok = ok && copy.count("1") == 0 && copy.at("1001") == "b";
+    ASSERT_M(ok, "copy strings");
+}
+
+//
+// Test that copies share the cells of elements they have not written.
+//
+template<class Implementation>
+void test_shared_cells()
+{
+    Implementation imp;
+    for (int i = 0; i < 100; ++i)
+    {
+        imp[std::to_string(i)] = std::string(100, 'a');
+    }
+
+    auto copy = imp;
+    copy["1"] = "b";
+    copy.erase("2");
+    copy["100"] = "c";
+
+    bool ok = copy.shares_cell(imp, "0") && copy.shares_cell(imp, "99");
+    ok = ok && !copy.shares_cell(imp, "1") && !copy.shares_cell(imp, "2");
+    ok = ok && imp.at("1") == std::string(100, 'a') && copy.at("1") == "b";
+    ok = ok && imp.count("2") == 1 && imp.count("100") == 0;
+    ok = ok && copy.size() == 100 && copy.at("100") == "c";
+    ASSERT_M(ok, "copy shares unwritten cells");
+
+    // a cell no other copy shares is written in place.
+    auto & mapped = copy["1"];
+    ASSERT_M(&copy["1"] == &mapped, "unshared cell written in place");
+}
+
+template<class Map>
+void test_stats()
+{
+    Map m;
+    for (int i = 0; i < 10; ++i)
+    {
+        m.insert_or_assign(i, i);
+    }
+    auto stats = m.stats();
+    ASSERT_M(stats.writes == 10 && stats.clones == 10, "stats writes");
+    ASSERT_M(stats.entries_copied == 45, "stats entries copied");
+    ASSERT_M(
+        stats.bytes_copied == 45 * sizeof(typename Map::value_type),
+        "stats bytes copied"
+    );
+    ASSERT_M(stats.snapshots_alive == 1, "stats one version alive");
+
+    m.at(1);
+    m.count(2);
+    auto view = m.snapshot();
+    m.erase(3);
+    stats = m.stats();
+    // erase reads before it writes.
+    ASSERT_M(stats.reads == 4 && stats.writes == 11, "stats reads");
+    ASSERT_M(stats.snapshots_alive == 2, "stats pinned version alive");
+    view = typename Map::snapshot_type{};
+    ASSERT_M(m.stats().snapshots_alive == 1, "stats pinned version freed");
+
+    std::uint64_t reads = 0;
+    std::uint64_t writes = 0;
+    for (std::size_t i = 0; i < lockfree::map_stats::latency_buckets; ++i)
+    {
+        reads += stats.read_latency[i];
+        writes += stats.write_latency[i];
+    }
+    ASSERT_M(reads == stats.reads && writes == stats.writes, "histograms");
+
+    // concurrent writers count in their own shards.
+    Map m1;
+    std::vector<std::future<void>> writers;
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.push_back(std::async(
+            std::launch::async,
+            [&m1, t]()
+            {
+                for (int i = 0; i < 100; ++i)
+                {
+                    m1.insert_or_assign(t * 100 + i, i);
+                }
+            }
+        ));
+    }
+    for (auto & w : writers)
+    {
+        w.wait();
+    }
+    stats = m1.stats();
+    ASSERT_M(
+        stats.writes == 400 && stats.clones == 400 + stats.retries,
+        "stats concurrent writes"
+    );
+    ASSERT_M(stats.escalations <= stats.retries, "stats escalations");
+}
+
+//
+// Clones of implementations that share their elements with their copies
+// count only what copy construction copies.
+//
+void test_clone_cost()
+{
+    lockfree::map_template<
+        lockfree::hamt_map<int, int>, lockfree::stats_policy
+    > m1;
+    lockfree::map_template<
+        lockfree::delta_map<std::map<int, int>>, lockfree::stats_policy
+    > m2;
+    for (int i = 0; i < 10; ++i)
+    {
+        m1.insert_or_assign(i, i);
+        m2.insert_or_assign(i, i);
+    }
+
+    auto stats = m1.stats();
+    ASSERT_M(
+        stats.clones == 10 && stats.entries_copied == 0 &&
+        stats.bytes_copied == 0,
+        "stats clone shares nodes"
+    );
+
+    // each clone copies the delta, which holds every earlier write.
+    stats = m2.stats();
+    ASSERT_M(
+        stats.clones == 10 && stats.entries_copied == 45 &&
+        stats.bytes_copied == 45 * sizeof(std::pair<const int, int>),
+        "stats clone copies delta"
+    );
+}
+
+struct contention_stats_policy : lockfree::contention_policy
+{
+    using stats_type = lockfree::sharded_stats;
+};
+
+//
+// A large range insert competes with a stream of small writes. It must
+// complete, escalating if need be.
+//
+template<class Map>
+void test_contention()
+{
+    Map m;
+    std::vector<std::pair<int, int>> range;
+    for (int i = 1000; i < 21000; ++i)
+    {
+        range.emplace_back(i, i);
+    }
+
+    std::atomic<bool> done{ false };
+    std::vector<std::future<void>> small;
+    for (int t = 0; t < 3; ++t)
+    {
+        small.push_back(std::async(
+            std::launch::async,
+            [&m, &done, t]()
+            {
+                for (int i = 0; i < 100 || ! done; ++i)
+                {
+                    m[t * 100 + i % 100] = i;
+                }
+            }
+        ));
+    }
+
+    for (int i = 0; i < 5; ++i)
+    {
+        m.erase(1000 + i);
+        m.insert(range.begin(), range.end());
+    }
+    done = true;
+    for (auto & f : small)
+    {
+        f.wait();
+    }
+
+    ASSERT_M(m.size() == 20300, "large write completes under contention");
+    auto stats = m.stats();
+    ASSERT_M(stats.escalations <= stats.retries, "contention stats");
+}
+
+//
+// Mapped that records the thread that destroyed it.
+//
+struct destroyed_by
+{
+    static std::atomic<int> live;
+    static std::thread::id thread;
+
+    destroyed_by() { ++live; }
+    destroyed_by(const destroyed_by &) { ++live; }
+    destroyed_by & operator=(const destroyed_by &) = default;
+    ~destroyed_by()
+    {
+        thread = std::this_thread::get_id();
+        --live;
+    }
+    bool operator==(const destroyed_by &) const { return true; }
+};
+
+std::atomic<int> destroyed_by::live{0};
+std::thread::id destroyed_by::thread;
+
+template<class Map>
+void test_deferred_reclamation()
+{
+    // the reclaimer thread may be destroying meanwhile.
+    auto wait_live = [](int live) {
+        for (int i = 0; i < 1000 && destroyed_by::live != live; ++i)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+        return destroyed_by::live == live;
+    };
+
+    {
+        Map m;
+        m[1] = destroyed_by{};
+        auto view = m.snapshot();
+        m[2] = destroyed_by{};
+        m.erase(1);
+
+        // the last reference to the old implementations is released here,
+        // but they are destroyed by the reclaimer.
+        view = typename Map::snapshot_type{};
+        ASSERT_M(wait_live(1), "replaced implementations freed");
+    }
+
+    ASSERT_M(wait_live(0), "destroyed map freed");
+    ASSERT_M(
+        destroyed_by::thread != std::this_thread::get_id(),
+        "destroyed by the reclaimer"
+    );
+}
+
+//
+// Mapped that counts its copies, to check that writes move it.
+//
+struct counted
+{
+    static std::atomic<int> copies;
+
+    counted() = default;
+    explicit counted(int v) : value{v} {}
+    counted(const counted & other) : value{other.value} { ++copies; }
+    counted(counted && other) : value{other.value} { other.value = -1; }
+    counted & operator=(const counted & other)
+    {
+        value = other.value;
+        ++copies;
+        return *this;
+    }
+    counted & operator=(counted && other)
+    {
+        value = other.value;
+        other.value = -1;
+        return *this;
+    }
+    bool operator==(const counted & other) const
+    {
+        return value == other.value;
+    }
+
+    int value = 0;
+};
+
+std::atomic<int> counted::copies{0};
+
+template<class Map>
+void test_emplace()
+{
+    Map m;
+
+    // clones copy the elements already in the map, so count copies on an
+    // empty map only.
+    counted::copies = 0;
+    ASSERT_M(m.emplace(1, counted{10}), "emplace");
+    ASSERT_M(counted::copies == 0, "emplace moves");
+
+    ASSERT_M(! m.emplace(1, counted{11}), "emplace existing");
+    ASSERT_M(! m.try_emplace(1, 12), "try_emplace existing");
+    ASSERT_M(m.at(1).value == 10, "emplace keeps existing");
+
+    m.clear();
+    counted::copies = 0;
+    ASSERT_M(m.try_emplace(2, 20), "try_emplace");
+    ASSERT_M(counted::copies == 0, "try_emplace constructs in place");
+
+    m.clear();
+    counted::copies = 0;
+    counted c{30};
+    ASSERT_M(m.insert_or_assign(3, std::move(c)), "insert_or_assign");
+    ASSERT_M(counted::copies == 0 && c.value == -1, "insert_or_assign moves");
+    ASSERT_M(! m.insert_or_assign(3, counted{31}), "insert_or_assign assign");
+    ASSERT_M(m.at(3).value == 31, "insert_or_assign assigned");
+
+    m[3] = counted{32};
+    ASSERT_M(m.at(3).value == 32, "move assign mapped");
+
+    // retried writes must not lose the moved value.
+    Map m1;
+    std::vector<std::future<void>> writers;
+    for (int t = 0; t < 4; ++t)
+    {
+        writers.push_back(std::async(
+            std::launch::async,
+            [&m1, t]()
+            {
+                for (int i = 0; i < 200; ++i)
+                {
+                    m1.insert_or_assign(i % 50, counted{t * 1000 + i});
+                    m1.emplace(1000 + t * 200 + i, counted{i});
+                }
+            }
+        ));
+    }
+    for (auto & w : writers)
+    {
+        w.wait();
+    }
+
+    bool ok = m1.size() == 850;
+    for (int k = 0; k < 50; ++k)
+    {
+        auto v = m1.at(k).value;
+        ok = ok && v >= 0 && v % 1000 % 50 == k;
+    }
+    for (int t = 0; t < 4; ++t)
+    {
+        for (int i = 0; i < 200; ++i)
+        {
+            ok = ok && m1.at(1000 + t * 200 + i).value == i;
+        }
+    }
+    ASSERT_M(ok, "concurrent move writes");
+}
+
+//
+// Hash that maps all keys to a few values, to exercise collisions.
+//
+struct poor_hash
+{
+    std::size_t operator()(int key) const
+    {
+        return std::hash<int>{}(key % 3);
+    }
+};
+
+template<class Implementation>
+void test_collisions()
+{
+    Implementation imp;
+    for (int key = 0; key < 100; ++key)
+    {
+        imp[key] = key;
+    }
+    for (int key = 0; key < 100; key += 2)
+    {
+        imp.erase(key);
+    }
+
+    bool ok = imp.size() == 50;
+    for (int key = 0; key < 100; ++key)
+    {
+        ok = ok && imp.count(key) == size_t(key % 2);
+    }
+    int n = 0;
+    for (const auto & item : imp)
+    {
+        ok = ok && item.first == item.second;
+        ++n;
+    }
+    ASSERT_M(ok && n == 50, "collisions");
+}
+
+//
+// Test ordered iteration and bounds of an ordered implementation against
+// std::map, over enough elements to split and merge nodes.
+//
+template<class Implementation>
+void test_ordered()
+{
+    Implementation imp;
+    std::map<int, int> reference;
+    for (int key = 0; key < 10000; key += 2)
+    {
+        imp[key] = key;
+        reference[key] = key;
+    }
+    for (int key = 0; key < 10000; key += 6)
+    {
+        imp.erase(key);
+        reference.erase(key);
+    }
+
+    // compare members, since flat_map iterates pairs of references.
+    auto same = [](
+        typename Implementation::const_iterator::reference a,
+        const std::pair<const int, int> & b
+    ) {
+        return a.first == b.first && a.second == b.second;
+    };
+    ASSERT_M(
+        std::equal(imp.begin(), imp.end(), reference.begin(), same) &&
+        imp.size() == reference.size(),
+        "ordered iteration"
+    );
+
+    bool ok = true;
+    for (int key = -1; key < 10002; ++key)
+    {
+        auto lower = imp.lower_bound(key);
+        auto upper = imp.upper_bound(key);
+        auto ref_lower = reference.lower_bound(key);
+        auto ref_upper = reference.upper_bound(key);
+        ok = ok && (lower == imp.end()) == (ref_lower == reference.end());
+        ok = ok && (upper == imp.end()) == (ref_upper == reference.end());
+        ok = ok && (lower == imp.end() || lower->first == ref_lower->first);
+        ok = ok && (upper == imp.end() || upper->first == ref_upper->first);
+    }
+    ASSERT_M(ok, "lower_bound upper_bound");
+}
+
+//
+// Range queries of a lockfree map over an ordered implementation.
+//
+template<class Map>
+void test_range()
+{
+    Map m;
+    for (int key = 0; key < 100; key += 10)
+    {
+        m[key] = key + 1;
+    }
+
+    ASSERT_M(m.lower_bound(20)->first == 20, "lower_bound");
+    ASSERT_M(m.lower_bound(21)->first == 30, "lower_bound");
+    ASSERT_M(m.upper_bound(20)->first == 30, "upper_bound");
+    ASSERT_M(m.lower_bound(91) == m.end(), "lower_bound end");
+
+    // an iterator stays on its version of the map.
+    auto itr = m.lower_bound(40);
+    m.erase(50);
+    ++itr;
+    ASSERT_M(itr->first == 50 && m.lower_bound(41)->first == 60,
+        "lower_bound version");
+    m[50] = 51;
+
+    std::vector<int> keys;
+    int sum = 0;
+    auto visited = m.for_each_in_range(25, 60,
+        [&](typename Map::snapshot_type::const_iterator::reference item) {
+            keys.push_back(item.first);
+            sum += item.second;
+        }
+    );
+    ASSERT_M(visited == 3 && keys == (std::vector<int>{ 30, 40, 50 }),
+        "for_each_in_range");
+    ASSERT_M(sum == 123, "for_each_in_range");
+
+    auto none = [](typename Map::snapshot_type::const_iterator::reference) {};
+    ASSERT_M(m.for_each_in_range(60, 60, none) == 0, "for_each_in_range empty");
+    ASSERT_M(m.for_each_in_range(60, 20, none) == 0,
+        "for_each_in_range reversed");
+    ASSERT_M(m.for_each_in_range(-5, 1000, none) == 10,
+        "for_each_in_range all");
+
+    auto view = m.snapshot();
+    ASSERT_M(view.lower_bound(35)->first == 40 &&
+        view.upper_bound(90) == view.end(), "snapshot bounds");
+}
+
+//
+// for_each_in_range passes the elements of a flat_map by reference, not
+// copies of them.
+//
+void test_range_references()
+{
+    lockfree::sorted_vector_map<int, std::string> m;
+    for (int key = 0; key < 100; key += 10)
+    {
+        m[key] = std::string(40, 'a' + key / 10);
     }
-    actual.sort();  // needed for unordered_map
-    ASSERT_M(actual == expected, "iteration");
 
-    // find
-    ASSERT_M(m1.find(5)->second == 6, "find");
-    ASSERT_M(m1.find(11) == m1.end(), "find end");
+    auto view = m.snapshot();
+    bool ok = true;
+    auto visited = m.for_each_in_range(20, 70,
+        [&](lockfree::sorted_vector_map<
+            int, std::string
+        >::snapshot_type::const_iterator::reference item) {
+            ok = ok && &item.second == &view.at(item.first);
+        }
+    );
+    ASSERT_M(visited == 5 && ok, "for_each_in_range by reference");
+}
 
-    // equal_range
-    ASSERT_M(m1.equal_range(5).first->second == 6, "equal_range");
+//
+// Bulk load of sorted ranges of many sizes, then writes to the loaded map.
+//
+template<class Map>
+void test_bulk_load(bool checks_order)
+{
+    bool ok = true;
+    for (int size : { 0, 1, 7, 33, 1000, 5000 })
+    {
+        std::vector<std::pair<int, int>> sorted;
+        for (int key = 0; key < size; ++key)
+        {
+            sorted.emplace_back(2 * key, key);
+        }
 
-    //count
-    ASSERT_M(m1.count(5) == 1, "count");
-    ASSERT_M(m1.count(11) == 0, "count");
+        auto m = Map::from_sorted(sorted.begin(), sorted.end());
+        ok = ok && m.size() == static_cast<std::size_t>(size);
+        for (int key = 0; ok && key < size; ++key)
+        {
+            ok = m.at(2 * key) == key && m.count(2 * key + 1) == 0;
+        }
 
-    // max_size
-    ASSERT_M(m1.max_size() > 1, "max_size");
+        // erase most, and insert between, the loaded keys.
+        for (int key = 0; key < size; ++key)
+        {
+            if (key % 4 != 0)
+            {
+                m.erase(2 * key);
+            }
+            m[2 * key + 1] = key;
+        }
+        std::size_t expected = 0;
+        for (auto item : m)
+        {
+            ok = ok && (item.first % 2 == 1 || item.first % 8 == 0);
+            ++expected;
+        }
+        ok = ok && m.size() == expected &&
+            expected == static_cast<std::size_t>(size + (size + 3) / 4);
+    }
+    ASSERT_M(ok, "from_sorted");
+
+    std::vector<std::pair<int, int>> sorted{ { 1,2 },{ 3,4 },{ 5,6 } };
+    Map m{ typename Map::implementation_type{ { 7,8 } } };
+    m.bulk_load(sorted.begin(), sorted.end());
+    ASSERT_M(m.size() == 3 && m.at(3) == 4 && m.count(7) == 0, "bulk_load");
+
+    if (checks_order)
+    {
+        std::vector<std::pair<int, int>> unsorted{ { 1,2 },{ 5,6 },{ 3,4 } };
+        try
+        {
+            m.bulk_load(unsorted.begin(), unsorted.end());
+            FAIL_M("bulk_load unsorted");
+        }
+        catch (const std::invalid_argument &)
+        {
+            ASSERT_M(m.size() == 3, "bulk_load unsorted");
+        }
+    }
 }
 
-template<class Map>
-void test_write(Map &)
+//
+// Save a map to a file, open it mapped, and write to the opened map.
+//
+void test_file_map()
 {
-    Map m1{
-        typename Map::implementation_type{ { 1,2 },{ 3,4 },{ 5,6 },{ 7,8 } }
-    };
+    using file_map = lockfree::file_map<int, int>;
+    const std::string path = "test_file_map.map";
 
-    // indexing
-    m1[5] = 99;
-    ASSERT_M(m1.at(5) == 99, "indexing");
-    m1[17] = 100;
-    ASSERT_M(m1.at(17) == 100, "indexing");
+    lockfree::unordered_map<int, int> source;
+    for (int key = 0; key < 1000; ++key)
+    {
+        source[key * 3] = key;
+    }
+    file_map::save(source, path);
 
-    // insert
-    std::vector<std::pair<int, int>> v{ { 21,22 },{ 23,24 },{ 25,26 } };
+    lockfree::mapped_file_map<int, int> m{ file_map::open(path) };
+    auto before = m.snapshot();
+    ASSERT_M(before.implementation().is_mapped(), "file_map open");
+    bool ok = m.size() == 1000;
+    int previous = -1;
+    for (auto item : m)
+    {
+        ok = ok && item.first > previous && item.second * 3 == item.first;
+        previous = item.first;
+    }
+    ASSERT_M(ok && m.count(1) == 0, "file_map contents");
+
+    m[1] = 100;
+    m.erase(0);
+    ASSERT_M(m.at(1) == 100 && m.count(0) == 0 && m.size() == 1000,
+        "file_map write");
+    ASSERT_M(!m.snapshot().implementation().is_mapped(), "file_map copied");
+    ASSERT_M(before.count(0) == 1 && before.count(1) == 0 &&
+        before.implementation().is_mapped(), "file_map snapshot kept");
+
+    // the file is not written through the map, and can be saved over.
+    auto reopened = file_map::open(path);
+    ASSERT_M(reopened.size() == 1000 && reopened.count(1) == 0,
+        "file_map file unchanged");
+    file_map::save(m, path);
+    ASSERT_M(file_map::open(path).at(1) == 100 && reopened.count(1) == 0,
+        "file_map save over");
+
+    // concurrent saves to one path write a whole map each, and the last
+    // rename wins.
+    std::vector<std::thread> savers;
+    std::atomic<bool> failed{ false };
+    for (int t = 0; t < 4; ++t)
+    {
+        savers.emplace_back([&path, &failed, t]() {
+            lockfree::map<int, int> saved;
+            for (int key = 0; key < 1000; ++key)
+            {
+                saved[key] = t;
+            }
+            try
+            {
+                for (int i = 0; i < 10; ++i)
+                {
+                    file_map::save(saved, path);
+                }
+            }
+            catch (...)
+            {
+                failed = true;
+            }
+        });
+    }
+    for (auto & t : savers)
+    {
+        t.join();
+    }
+    auto saved = file_map::open(path);
+    ok = !failed && saved.size() == 1000;
+    for (auto item : saved)
+    {
+        ok = ok && item.second == saved.at(0) && item.second < 4;
+    }
+    ASSERT_M(ok, "file_map concurrent saves");
+
+    lockfree::map<int, int> empty;
+    file_map::save(empty, path);
+    ASSERT_M(file_map::open(path).empty(), "file_map empty");
+
+    file_map::save(source, path);
+    try
+    {
+        lockfree::file_map<int, double>::open(path);
+        FAIL_M("file_map other type");
+    }
+    catch (const std::runtime_error &)
+    {
+        PASS_M("file_map other type");
+    }
+
+    {
+        std::ofstream garbage{ path, std::ios::binary | std::ios::trunc };
+        garbage << "not a map";
+    }
+    try
+    {
+        file_map::open(path);
+        FAIL_M("file_map not a map file");
+    }
+    catch (const std::runtime_error &)
+    {
+        PASS_M("file_map not a map file");
+    }
+
+    std::remove(path.c_str());
+    try
+    {
+        file_map::open(path);
+        FAIL_M("file_map missing file");
+    }
+    catch (const std::system_error &)
+    {
+        PASS_M("file_map missing file");
+    }
+}
+
+template<class ShardedMap>
+void test_sharded()
+{
+    ShardedMap m1{ 8 };
+    ASSERT_M(m1.shard_count() == 8 && m1.empty(), "sharded construct");
+
+    std::vector<std::pair<int, int>> v;
+    for (int i = 0; i < 1000; ++i)
+    {
+        v.emplace_back(i, i * 2);
+    }
     m1.insert(v.begin(), v.end());
-    std::list<int> expected{ 1,3,5,7,17,21,23,25 };
-    std::list<int> actual;
-    for (auto item : m1)
+    m1[1000] = 2000;
+    ASSERT_M(m1.size() == 1001, "sharded size");
+    ASSERT_M(m1.at(500) == 1000 && m1[1000] == 2000, "sharded at");
+    ASSERT_M(*m1.pin(500) == 1000 && !m1.pin(-1), "sharded pin");
+    ASSERT_M(m1.erase(0) == 1 && m1.count(0) == 0, "sharded erase");
+
+    std::vector<int> keys;
+    bool ok = true;
+    for (const auto & item : m1)
     {
-        actual.push_back(item.first);
+        keys.push_back(item.first);
+        ok = ok && item.second == item.first * 2;
     }
-    actual.sort();  // needed for unordered_map
-    ASSERT_M(actual == expected, "insert");
+    std::sort(keys.begin(), keys.end());
+    ASSERT_M(ok && keys.size() == 1000 && keys.front() == 1, "sharded iterate");
 
-    m1.erase(17);
-    ASSERT_M(m1.find(17) == m1.end(), "erase");
+    auto view = m1.snapshot();
+    m1[1] = -1;
+    ASSERT_M(view.at(1) == 2 && view.size() == 1000, "sharded snapshot");
+    ASSERT_M(view.find(1)->second == 2, "sharded snapshot find");
+    ASSERT_M(view.find(0) == view.end(), "sharded snapshot find end");
+    ASSERT_M(
+        std::distance(view.begin(), view.end()) == 1000,
+        "sharded snapshot iterate"
+    );
+
+    // a writer writes key a and then key b, on different shards.
+    // A consistent snapshot never sees the write to b without the one to a.
+    int a = 0;
+    int b = 1;
+    while (&m1.shard(a) == &m1.shard(b))
+    {
+        ++b;
+    }
+    m1[a] = 0;
+    m1[b] = 0;
+    std::atomic<bool> stop{ false };
+    auto writer = std::async(std::launch::async, [&]() {
+        for (int i = 1; !stop; ++i)
+        {
+            m1[a] = i;
+            m1[b] = i;
+        }
+    });
+    ok = true;
+    for (int i = 0; i < 2000; ++i)
+    {
+        auto s = m1.snapshot();
+        ok = ok && s.at(b) <= s.at(a) && s.at(a) <= s.at(b) + 1;
+    }
+    stop = true;
+    writer.wait();
+    ASSERT_M(ok, "sharded snapshot consistent");
 
-    ASSERT_M(!m1.empty(), "empty");
     m1.clear();
-    ASSERT_M(m1.size() == 0, "clear");
-    ASSERT_M(m1.empty(), "empty");
+    ASSERT_M(m1.empty() && m1.begin() == m1.end(), "sharded clear");
+
+    // a snapshot outlives its map.
+    auto orphan = [&v]() {
+        ShardedMap m2{ 4 };
+        m2.insert(v.begin(), v.end());
+        return m2.snapshot();
+    }();
+    ok = orphan.size() == 1000 && orphan.count(-1) == 0;
+    for (int key = 0; key < 1000; key += 7)
+    {
+        ok = ok && orphan.at(key) == key * 2 && orphan.find(key)->second == key * 2;
+    }
+    ASSERT_M(ok, "sharded snapshot outlives map");
 }
 
+//
+// Writers write while a delta_compactor compacts, and a reader checks that
+// every snapshot has the keys that no writer erases.
+//
 template<class Map>
-void test_interface(Map & m)
+void test_compaction()
 {
-    test_construct_assign(m);
-    test_read(m);
-    test_write(m);
+    Map m1;
+    for (int key = 0; key < 1000; ++key)
+    {
+        m1[key] = key;
+    }
+    m1.compact();
+    ASSERT_M(
+        m1.snapshot().implementation().delta_size() == 0,
+        "compact on demand"
+    );
+
+    std::atomic<bool> bad{ false };
+    {
+        lockfree::delta_compactor<Map> compactor{
+            m1, std::chrono::milliseconds{ 1 }
+        };
+
+        std::vector<std::future<void>> writers;
+        for (int w = 0; w < 2; ++w)
+        {
+            writers.push_back(std::async(std::launch::async, [&m1, w]() {
+                for (int i = 0; i < 3000; ++i)
+                {
+                    // writer w writes odd keys 1000 + 2 * i + w, erases
+                    // some of them, and overwrites even keys < 1000.
+                    int key = 1000 + 2 * (i % 500) + w;
+                    if (i % 3 == 2)
+                    {
+                        m1.erase(key);
+                    }
+                    else
+                    {
+                        m1[key] = key;
+                    }
+                    m1[(i * 2) % 1000] = (i * 2) % 1000;
+                }
+            }));
+        }
+
+        auto reader = std::async(std::launch::async, [&]() {
+            for (int i = 0; i < 300; ++i)
+            {
+                auto view = m1.snapshot();
+                for (int key = 0; key < 1000; key += 37)
+                {
+                    if (view.count(key) != 1 || view.at(key) != key)
+                    {
+                        bad = true;
+                    }
+                }
+            }
+        });
+
+        for (auto & w : writers)
+        {
+            w.wait();
+        }
+        reader.wait();
+    }
+    ASSERT_M(!bad, "compaction keeps elements");
+
+    std::map<int, int> reference;
+    for (int key = 0; key < 1000; ++key)
+    {
+        reference[key] = key;
+    }
+    for (int w = 0; w < 2; ++w)
+    {
+        for (int i = 0; i < 3000; ++i)
+        {
+            int key = 1000 + 2 * (i % 500) + w;
+            if (i % 3 == 2)
+            {
+                reference.erase(key);
+            }
+            else
+            {
+                reference[key] = key;
+            }
+        }
+    }
+
+    std::map<int, int> actual;
+    for (auto item : m1)
+    {
+        actual.insert(item);
+    }
+    ASSERT_M(
+        actual == reference && m1.size() == reference.size(),
+        "compaction contents"
+    );
+}
+
+//
+// Writes through operator[] that reach the compaction threshold keep the
+// element they write.
+//
+void test_compaction_threshold()
+{
+    using delta = lockfree::delta_map<std::map<int, int>>;
+
+    lockfree::overlay_map<int, int> m1{ delta{ std::map<int, int>{
+        { 1, 100 }
+    }, 4 } };
+    for (int key = 2; key < 5; ++key)
+    {
+        m1[key] = key;
+    }
+    ASSERT_M(
+        m1.snapshot().implementation().delta_size() == 3,
+        "delta below threshold"
+    );
+    auto updated = m1.update(1, [](int v) { return v + 1; });
+    ASSERT_M(
+        updated == 101 && m1.at(1) == 101,
+        "update at compaction threshold"
+    );
+
+    delta d{ std::map<int, int>{ { 1, 100 } }, 4 };
+    for (int key = 2; key < 20; ++key)
+    {
+        d[key] += key;
+        d[1] += 1;
+    }
+    bool ok = d.size() == 19 && d.at(1) == 118;
+    for (int key = 2; key < 20; ++key)
+    {
+        ok = ok && d.at(key) == key;
+    }
+    ASSERT_M(ok, "operator[] at compaction threshold");
 }
 
 template <typename K, typename M>
@@ -352,10 +1541,131 @@ void test_concurrent4x_read_write_modify(Map &)
     ASSERT_M(m1[range_end+1] == range_end+1, "map data integrity");
 }
 
+//
+// Counters incremented by 4 threads with update and compare_and_set.
+// No increment may be lost.
+//
+template<class Map>
+void test_concurrent_update(Map &)
+{
+    Map m1;
+    const int increments = 2000;
+
+    std::atomic<bool> wait{ true };
+    std::atomic<unsigned int> concurrency{ 0 };
+
+    auto threadfunc = [&m1, &concurrency, &wait, increments]() {
+        concurrency++;
+        while (wait) {};
+        for (int i = 0; i < increments; ++i)
+        {
+            m1.update(i % 4, [](const int & mapped) { return mapped + 1; });
+
+            int current = m1.compute_if_absent(4, []() { return 0; });
+            while (!m1.compare_and_set(4, current, current + 1))
+            {
+                current = m1.at(4);
+            }
+        }
+    };
+
+    auto t1 = std::thread(threadfunc);
+    auto t2 = std::thread(threadfunc);
+    auto t3 = std::thread(threadfunc);
+    auto t4 = std::thread(threadfunc);
+    while (concurrency < 4);
+    wait = false;
+    t1.join();
+    t2.join();
+    t3.join();
+    t4.join();
+
+    int total = 0;
+    for (int key = 0; key < 4; ++key)
+    {
+        total += m1.at(key);
+    }
+    ASSERT_M(total == 4 * increments, "concurrent update");
+    ASSERT_M(m1.at(4) == 4 * increments, "concurrent compare_and_set");
+}
+
+//
+// A writer whose update throws gets its own exception, and neither its
+// half done write nor the exception reaches concurrent writers.
+//
+template<class Map>
+void test_throwing_writer(Map &)
+{
+    Map m1;
+    const int updates = 2000;
+
+    std::atomic<bool> wait{ true };
+    std::atomic<unsigned int> concurrency{ 0 };
+    std::atomic<int> caught{ 0 };
+    std::atomic<int> misdirected{ 0 };
+
+    auto thrower = [&]() {
+        concurrency++;
+        while (wait) {};
+        for (int i = 0; i < updates; ++i)
+        {
+            try
+            {
+                // update inserts key 100 in its clone before fn throws.
+                m1.update(100, [](const int &) -> int {
+                    throw std::runtime_error{ "thrower" };
+                });
+            }
+            catch (const std::runtime_error &)
+            {
+                caught++;
+            }
+        }
+    };
+    auto writer = [&](int key) {
+        concurrency++;
+        while (wait) {};
+        for (int i = 0; i < updates; ++i)
+        {
+            try
+            {
+                m1.update(key, [](const int & mapped) { return mapped + 1; });
+            }
+            catch (...)
+            {
+                misdirected++;
+            }
+        }
+    };
+
+    auto t1 = std::thread(thrower);
+    auto t2 = std::thread(writer, 0);
+    auto t3 = std::thread(writer, 1);
+    auto t4 = std::thread(writer, 2);
+    while (concurrency < 4);
+    wait = false;
+    t1.join();
+    t2.join();
+    t3.join();
+    t4.join();
+
+    ASSERT_M(
+        caught == updates && misdirected == 0,
+        "exception only in throwing writer"
+    );
+    ASSERT_M(
+        m1.at(0) == updates && m1.at(1) == updates && m1.at(2) == updates &&
+        m1.count(100) == 0,
+        "writes beside a throwing writer"
+    );
+}
+
 template<class Map>
 void test_concurrency(Map & m)
 {
     test_concurrent_writes(m);
+    test_concurrent_update(m);
+    test_throwing_writer(m);
     test_concurrent4x_read_write_modify(m);
 }
 
@@ -379,10 +1689,137 @@ int main(int , char ** )
     test_interface(map_ord);
     test_concurrency(map_ord);
 
+    test_range<lockfree::map<int, int>>();
+    test_bulk_load<lockfree::map<int, int>>(false);
+    test_bulk_load<lockfree::unordered_map<int, int>>(false);
+
     lockfree::unordered_map<int, int> map_unord;
     test_interface(map_unord);
     test_concurrency(map_unord);
 
+    lockfree::map_template<std::map<int, int>, lockfree::combining_policy>
+        map_comb;
+    test_interface(map_comb);
+    test_concurrency(map_comb);
+
+    lockfree::map_template<std::unordered_map<int, int>, lockfree::epoch_policy>
+        map_epoch;
+    test_interface(map_epoch);
+    test_concurrency(map_epoch);
+
+    lockfree::persistent_unordered_map<int, int> map_hamt;
+    test_interface(map_hamt);
+    test_concurrency(map_hamt);
+    test_persistent<lockfree::hamt_map<int, int>>();
+    test_bulk_load<lockfree::persistent_unordered_map<int, int>>(false);
+    test_collisions<lockfree::hamt_map<int, int, poor_hash>>();
+
+    lockfree::persistent_map<int, int> map_btree;
+    test_interface(map_btree);
+    test_concurrency(map_btree);
+    test_persistent<lockfree::btree_map<int, int>>();
+    test_ordered<lockfree::btree_map<int, int>>();
+    test_range<lockfree::persistent_map<int, int>>();
+    test_bulk_load<lockfree::persistent_map<int, int>>(true);
+
+    lockfree::sorted_vector_map<int, int> map_flat;
+    test_interface(map_flat);
+    test_concurrency(map_flat);
+    test_persistent<lockfree::flat_map<int, int>>();
+    test_ordered<lockfree::flat_map<int, int>>();
+    test_range<lockfree::sorted_vector_map<int, int>>();
+    test_range_references();
+    test_bulk_load<lockfree::sorted_vector_map<int, int>>(true);
+
+    lockfree::mapped_file_map<int, int> map_file;
+    test_interface(map_file);
+    test_concurrency(map_file);
+    test_ordered<lockfree::file_map<int, int>>();
+    test_range<lockfree::mapped_file_map<int, int>>();
+    test_bulk_load<lockfree::mapped_file_map<int, int>>(true);
+    test_file_map();
+
+    lockfree::flat_unordered_map<int, int> map_swiss;
+    test_interface(map_swiss);
+    test_concurrency(map_swiss);
+    test_persistent<lockfree::swiss_map<int, int>>();
+    test_collisions<lockfree::swiss_map<int, int, poor_hash>>();
+    test_copy_strings<lockfree::swiss_map<std::string, std::string>>();
+
+    lockfree::overlay_map<int, int> map_overlay;
+    test_interface(map_overlay);
+    test_concurrency(map_overlay);
+    test_persistent<lockfree::delta_map<std::map<int, int>>>();
+    test_persistent<lockfree::delta_map<lockfree::hamt_map<int, int>>>();
+    test_collisions<
+        lockfree::delta_map<std::unordered_map<int, int, poor_hash>>
+    >();
+    test_compaction<lockfree::overlay_unordered_map<int, int>>();
+    test_compaction_threshold();
+
+    lockfree::map_template<
+        std::map<int, int>, lockfree::stats_policy
+    > map_stats;
+    test_interface(map_stats);
+    test_concurrency(map_stats);
+    test_stats<decltype(map_stats)>();
+    test_clone_cost();
+
+    lockfree::map_template<
+        std::map<int, int>, lockfree::contention_policy
+    > map_contention;
+    test_interface(map_contention);
+    test_concurrency(map_contention);
+    test_contention<
+        lockfree::map_template<std::map<int, int>, contention_stats_policy>
+    >();
+
+    lockfree::map_template<
+        std::unordered_map<int, int>, lockfree::deferred_reclamation_policy
+    > map_deferred;
+    test_interface(map_deferred);
+    test_concurrency(map_deferred);
+    test_deferred_reclamation<
+        lockfree::map_template<
+            std::map<int, destroyed_by>,
+            lockfree::deferred_reclamation_policy
+        >
+    >();
+
+    lockfree::shared_cells_map<int, int> map_cells;
+    test_interface(map_cells);
+    test_concurrency(map_cells);
+    lockfree::shared_cells_unordered_map<int, int> map_cells_unord;
+    test_interface(map_cells_unord);
+    test_concurrency(map_cells_unord);
+    test_persistent<lockfree::shared_cells<std::map<int, int>>>();
+    test_collisions<
+        lockfree::shared_cells<std::unordered_map<int, int, poor_hash>>
+    >();
+    test_copy_strings<
+        lockfree::shared_cells<std::unordered_map<std::string, std::string>>
+    >();
+    test_shared_cells<
+        lockfree::shared_cells<std::map<std::string, std::string>>
+    >();
+    test_shared_cells<
+        lockfree::shared_cells<std::unordered_map<std::string, std::string>>
+    >();
+
+    test_sharded<lockfree::sharded_map<int, int>>();
+    test_sharded<lockfree::sharded_unordered_map<int, int>>();
+
+    test_emplace<lockfree::map<int, counted>>();
+    test_emplace<lockfree::unordered_map<int, counted>>();
+    test_emplace<
+        lockfree::map_template<
+            std::map<int, counted>, lockfree::combining_policy
+        >
+    >();
+    test_emplace<lockfree::map_template<lockfree::hamt_map<int, counted>>>();
+    test_emplace<lockfree::map_template<lockfree::flat_map<int, counted>>>();
+    test_emplace<lockfree::map_template<lockfree::swiss_map<int, counted>>>();
+
     test_myMap();
 
     // Enable this code to verify the strength of concurrency tests.
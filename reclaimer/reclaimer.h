@@ -0,0 +1,216 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Deferred destruction of objects on a background thread in C++11.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+/*
+Notes:
+1.  Whichever thread releases the last shared_ptr to an object runs its
+    destructor. For a large object, eg an old version of a lockfree::map,
+    that is a long stall in a thread that merely stopped reading it.
+    A shared_ptr made by reclaimer::make_shared instead hands the object to
+    the reclaimer. The releasing thread pays one small allocation and one
+    compare exchange, and the reclaimer thread runs the destructor.
+2.  Retiring is a compare exchange. Only the retire that finds nothing
+    retired also locks a mutex briefly, to wake the reclaimer thread, which
+    then destroys everything retired so far. So the thread sleeps while
+    nothing is retired, and a burst of retires wakes it once. drain() does
+    the same in the calling thread, eg before measuring memory.
+3.  There is one reclaimer, started on first use and stopped at exit, when
+    it destroys whatever is left. An object that retires objects at exit,
+    eg a static map, must be constructed after the reclaimer is. Using
+    reclaimer::instance() or reclaimer::make_shared in its constructor
+    ensures that.
+*/
+
+namespace lockfree
+{
+
+class reclaimer
+{
+public:
+    static reclaimer & instance ()
+    {
+        static reclaimer reclaimer;
+        return reclaimer;
+    }
+
+    reclaimer (const reclaimer &) = delete;
+    reclaimer & operator = (const reclaimer &) = delete;
+
+    ~reclaimer ()
+    {
+        {
+            std::lock_guard <std::mutex> lock {mutex_};
+            stop_ = true;
+        }
+        wake_.notify_one ();
+        thread_.join ();
+
+        drain ();
+    }
+
+    //
+    // Destroy p with deleter on the reclaimer thread.
+    //
+    void retire (void * p, void (* deleter) (void *))
+    {
+        auto r = new retired {p, deleter, nullptr};
+        auto head = retired_.load (std::memory_order_relaxed);
+        do
+        {
+            r->next = head;
+        }
+        while ( !
+            retired_.compare_exchange_weak (
+                head, r, std::memory_order_release
+            )
+        );
+
+        // r may be destroyed already, so test head rather than r->next.
+        // The reclaimer thread may be waiting for the list to be non-empty.
+        // Taking the mutex ensures it is either waiting, and so is woken, or
+        // yet to see the list.
+        if (! head)
+        {
+            {
+                std::lock_guard <std::mutex> lock {mutex_};
+            }
+            wake_.notify_one ();
+        }
+    }
+
+    //
+    // Destroy everything retired so far in the calling thread.
+    // Returns the number of objects destroyed.
+    //
+    std::size_t drain ()
+    {
+        std::size_t drained = 0;
+
+        // objects destroyed may retire more objects.
+        for (
+            auto list = retired_.exchange (nullptr, std::memory_order_acquire);
+            list;
+            list = retired_.exchange (nullptr, std::memory_order_acquire)
+        )
+        {
+            while (list)
+            {
+                auto next = list->next;
+                list->deleter (list->p);
+                delete list;
+                list = next;
+                ++ drained;
+            }
+        }
+
+        destroyed_.fetch_add (drained, std::memory_order_relaxed);
+
+        return drained;
+    }
+
+    //
+    // Number of objects destroyed so far, by the reclaimer thread or by
+    // drain().
+    //
+    std::size_t destroyed () const noexcept
+    {
+        return destroyed_.load (std::memory_order_relaxed);
+    }
+
+    //
+    // Deleter of a shared_ptr that retires the object to the reclaimer.
+    //
+    template <typename T>
+    struct deleter
+    {
+        void operator () (T * p) const
+        {
+            instance ().retire (p, & destroy);
+        }
+
+        static void destroy (void * p)
+        {
+            delete static_cast <T *> (p);
+        }
+    };
+
+    //
+    // Like std::make_shared, but the object is destroyed by the reclaimer.
+    // Unlike std::make_shared, the object and its reference counts are two
+    // allocations.
+    //
+    template <typename T, typename... Args>
+    static std::shared_ptr <T> make_shared (Args && ... args)
+    {
+        instance ();
+
+        return std::shared_ptr <T> {
+            new T (std::forward <Args> (args)...), deleter <T> {}
+        };
+    }
+
+private:
+    reclaimer () : thread_ {[this] { run (); }}
+    {
+    }
+
+    struct retired
+    {
+        void * p;
+        void (* deleter) (void *);
+        retired * next;
+    };
+
+    void run ()
+    {
+        std::unique_lock <std::mutex> lock {mutex_};
+        for (;;)
+        {
+            wake_.wait (
+                lock,
+                [this]
+                {
+                    return
+                        stop_ ||
+                        retired_.load (std::memory_order_relaxed) != nullptr;
+                }
+            );
+            if (stop_)
+            {
+                return;
+            }
+
+            lock.unlock ();
+            drain ();
+            lock.lock ();
+        }
+    }
+
+    std::atomic <retired *> retired_ {nullptr};
+    std::atomic <std::size_t> destroyed_ {0};
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    bool stop_ = false;
+
+    // last, so that it starts once the members above are constructed.
+    std::thread thread_;
+};
+
+}
@@ -0,0 +1,164 @@
+#include "reclaimer.h"
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+using lockfree::reclaimer;
+using std::shared_ptr;
+using std::cout;
+
+void ok(bool cond, const std::string & what)
+{
+    cout << (cond ? "\nOK : " : "\nFAIL : ") << what;
+}
+
+//
+// Counts live instances, and records the thread that destroyed the last.
+//
+class counted
+{
+public:
+    explicit counted(int i) : i_(i)
+    {
+        ++live;
+    }
+
+    ~counted()
+    {
+        destroyer = std::this_thread::get_id();
+        --live;
+    }
+
+    int value() const
+    {
+        return i_;
+    }
+
+    static std::atomic<int> live;
+    static std::thread::id destroyer;
+
+private:
+    int i_;
+};
+
+std::atomic<int> counted::live{ 0 };
+std::thread::id counted::destroyer;
+
+//
+// Wait for the reclaimer thread to catch up, or give up after a while.
+//
+template<class Predicate>
+bool wait_for(Predicate done)
+{
+    for (int i = 0; i < 1000 && !done(); ++i)
+    {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    return done();
+}
+
+bool wait_live(int live)
+{
+    return wait_for([live]() { return counted::live == live; });
+}
+
+//
+// The last release of a deferred shared_ptr does not destroy its object.
+// The reclaimer thread does.
+//
+void test_deferred()
+{
+    auto p = reclaimer::make_shared<counted>(1);
+    auto q = p;
+    ok(p->value() == 1 && counted::live == 1, "make_shared");
+
+    p.reset();
+    q.reset();
+    ok(wait_live(0), "destroyed by the reclaimer");
+    ok(counted::destroyer != std::this_thread::get_id(), "on another thread");
+}
+
+//
+// The reclaimer thread sleeps while nothing is retired, and wakes up for
+// the next object retired.
+//
+void test_wake()
+{
+    reclaimer::instance().drain();
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+
+    reclaimer::make_shared<counted>(1).reset();
+    ok(wait_live(0), "woken by retire");
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    {
+        auto p = reclaimer::make_shared<counted>(2);
+        auto q = reclaimer::make_shared<counted>(3);
+    }
+    ok(wait_live(0), "woken again by retire");
+}
+
+//
+// drain destroys every retired object in the calling thread.
+//
+void test_drain()
+{
+    auto & r = reclaimer::instance();
+    r.drain();
+    auto destroyed = r.destroyed();
+
+    std::vector<shared_ptr<counted>> v;
+    for (int i = 0; i < 100; ++i)
+    {
+        v.push_back(reclaimer::make_shared<counted>(i));
+    }
+    v.clear();
+    r.drain();
+
+    // the reclaimer thread may be destroying some of them meanwhile.
+    ok(wait_live(0), "drain");
+    ok(
+        wait_for([&]() { return r.destroyed() == destroyed + 100; }),
+        "destroyed count"
+    );
+}
+
+//
+// Many threads retire concurrently. Nothing leaks.
+//
+void test_concurrent()
+{
+    const int num_threads = 4;
+    const int num_objects = 10000;
+
+    std::vector<std::thread> threads;
+    for (int t = 0; t < num_threads; ++t)
+    {
+        threads.emplace_back([]() {
+            for (int i = 0; i < num_objects; ++i)
+            {
+                auto p = reclaimer::make_shared<counted>(i);
+            }
+        });
+    }
+    for (auto & t : threads)
+    {
+        t.join();
+    }
+
+    ok(wait_live(0), "concurrent no leak");
+}
+
+int main(int, char **)
+{
+    test_deferred();
+    test_wake();
+    test_drain();
+    test_concurrent();
+    cout << "\ndone\n";
+    return 0;
+}
@@ -12,12 +12,13 @@
 #include <memory>
 #include <mutex>
 
+#include "../atomic_ptr/atomic_ptr.h"
+
 namespace lockfree
 {
 
 using std::shared_ptr;
 using std::weak_ptr;
-using std::bad_weak_ptr;
 using std::make_shared;
 using std::mutex;
 using std::unique_lock;
@@ -26,7 +27,8 @@ using std::unique_lock;
 Notes:
 1.  Lock-free once the single instance is constructed.
     Uses a lock while constructing the single instance.
-2.  Avoids incorrect double checked locking to achieve lock-free.
+2.  The single instance is published through an atomic_weak_ptr, which is
+    lock-free. This makes the double checked locking correct.
 3.  Releases the singleton object once the last client holding a reference
     releases it.
 4.  Please see test_singleton.cpp for usage example.
@@ -45,31 +47,30 @@ public:
     template<typename... P>
     static shared_ptr<T> instance(P&&... params)
     {
-        try
+        auto instance = instance_.load().lock();
+        if (instance)
         {
-            return shared_ptr<T> {instance_};
+            return instance;
         }
-        catch (const bad_weak_ptr &)
+
+        unique_lock<mutex> l(mtx_);
+        instance = instance_.load().lock();
+        if (!instance)
         {
-            unique_lock<mutex> l(mtx_);
-            auto instance = instance_.lock();
-            if (!instance)
-            {
-                // cannot use make_shared when T's constructors are private.
-                //instance = make_shared<T>(params...);
-                instance = shared_ptr<T>{new T{std::forward<P>(params)...}};
-                instance_ = instance;
-            }
-            return instance;
+            // cannot use make_shared when T's constructors are private.
+            //instance = make_shared<T>(params...);
+            instance = shared_ptr<T>{new T{std::forward<P>(params)...}};
+            instance_.store(instance);
         }
+        return instance;
     }
 private:
-    static weak_ptr<T> instance_;
+    static atomic_weak_ptr<T> instance_;
     static mutex mtx_;
 };
 
 template<typename T>
-weak_ptr<T> singleton<T>::instance_;
+atomic_weak_ptr<T> singleton<T>::instance_;
 
 template<typename T>
 mutex singleton<T>::mtx_;
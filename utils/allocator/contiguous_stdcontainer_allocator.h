@@ -0,0 +1,330 @@
+//----------------------------------------------------------------------------
+// year   : 2026
+// author : John Paul
+// email  : johnpaultaken@gmail.com
+// source : https://github.com/johnpaultaken
+// description :
+//      Arena allocator that keeps all elements of a std container in one
+//      contiguous region, freed in one go with the container.
+//----------------------------------------------------------------------------
+
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+#if defined (LOCKFREE_ARENA_HUGE_PAGES) && defined (__linux__)
+#include <sys/mman.h>
+#endif
+
+/*
+Notes:
+1.  contiguous_stdcontainer_allocator is constructed with the number of
+    elements its container is expected to hold. On the first allocation it
+    reserves one region sized for that many elements and their container
+    nodes, and hands out consecutive slices of it. So the nodes of a node
+    based container, eg std::map, are contiguous in memory, in the order
+    they were allocated, rather than scattered over the heap.
+2.  deallocate does nothing. The region is freed in one go when the last
+    copy of the allocator, ie the container, is destroyed. Erasing from a
+    container does not give memory back to its arena, so an arena suits a
+    container that is built once and then read, like a snapshot of a
+    lockfree::cache_optimized::map.
+3.  If the region is used up, another region, at least twice the size of
+    the last, is chained to it. The expected number of elements is a hint,
+    not a limit.
+4.  A copy constructed container gets a new arena, sized for all the memory
+    used by the arena of the container it is copied from. Copies of an
+    allocator share their arena, as do its rebinds.
+5.  With LOCKFREE_ARENA_HUGE_PAGES defined on Linux, regions of 2MB or more
+    are mapped with mmap and advised to use transparent huge pages.
+6.  An arena is not thread-safe. A container is only written by one thread
+    at a time anyway.
+*/
+
+namespace utils
+{
+
+//
+// Chain of regions, allocated by bumping a pointer.
+//
+class arena
+{
+public:
+    explicit arena (std::size_t bytes) noexcept : reserve_ {bytes}
+    {
+    }
+
+    arena (const arena &) = delete;
+    arena & operator = (const arena &) = delete;
+
+    ~arena ()
+    {
+        while (regions_)
+        {
+            auto next = regions_->next;
+            release (regions_);
+            regions_ = next;
+        }
+    }
+
+    void * allocate (std::size_t bytes, std::size_t alignment)
+    {
+        if (regions_)
+        {
+            auto p = bump (bytes, alignment);
+            if (p)
+            {
+                return p;
+            }
+        }
+
+        // the first region holds the reserve after its header.
+        std::size_t size = std::max (
+            reserve_ + sizeof (region) + alignment,
+            regions_ ? 2 * regions_->size : min_region
+        );
+        size = std::max (size, bytes + alignment + sizeof (region));
+        add_region (size);
+
+        return bump (bytes, alignment);
+    }
+
+    //
+    // bytes handed out so far, including alignment padding.
+    //
+    std::size_t used () const noexcept
+    {
+        return used_;
+    }
+
+    //
+    // number of regions, 1 if the reserve was large enough.
+    //
+    std::size_t regions () const noexcept
+    {
+        std::size_t count = 0;
+        for (auto r = regions_; r; r = r->next)
+        {
+            ++ count;
+        }
+
+        return count;
+    }
+
+    //
+    // Whether p was handed out by this arena.
+    //
+    bool owns (const void * p) const noexcept
+    {
+        auto address = reinterpret_cast <std::uintptr_t> (p);
+        for (auto r = regions_; r; r = r->next)
+        {
+            auto first = reinterpret_cast <std::uintptr_t> (r);
+            if (address >= first && address < first + r->size)
+            {
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+private:
+    static constexpr std::size_t min_region = 4096;
+    static constexpr std::size_t huge_page = 2 * 1024 * 1024;
+
+    //
+    // Header at the start of each region.
+    //
+    struct region
+    {
+        region * next;
+        std::size_t size;
+        bool mapped;
+    };
+
+    void * bump (std::size_t bytes, std::size_t alignment) noexcept
+    {
+        auto first = reinterpret_cast <std::uintptr_t> (regions_);
+        auto last = first + regions_->size;
+        auto aligned = (next_ + alignment - 1) & ~ (alignment - 1);
+        if (aligned + bytes > last)
+        {
+            return nullptr;
+        }
+
+        used_ += aligned + bytes - next_;
+        next_ = aligned + bytes;
+
+        return reinterpret_cast <void *> (aligned);
+    }
+
+    void add_region (std::size_t size)
+    {
+        void * memory = nullptr;
+        bool mapped = false;
+
+#if defined (LOCKFREE_ARENA_HUGE_PAGES) && defined (__linux__)
+        if (size >= huge_page)
+        {
+            size = (size + huge_page - 1) & ~ (huge_page - 1);
+            memory = mmap (
+                nullptr, size,
+                PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                -1, 0
+            );
+            if (memory == MAP_FAILED)
+            {
+                throw std::bad_alloc {};
+            }
+            madvise (memory, size, MADV_HUGEPAGE);
+            mapped = true;
+        }
+#endif
+        if (! memory)
+        {
+            memory = ::operator new (size);
+        }
+
+        auto r = new (memory) region {regions_, size, mapped};
+        regions_ = r;
+        next_ = reinterpret_cast <std::uintptr_t> (r) + sizeof (region);
+    }
+
+    static void release (region * r) noexcept
+    {
+#if defined (LOCKFREE_ARENA_HUGE_PAGES) && defined (__linux__)
+        if (r->mapped)
+        {
+            munmap (r, r->size);
+            return;
+        }
+#endif
+        ::operator delete (r);
+    }
+
+    // size of the first region.
+    std::size_t reserve_;
+
+    // newest region first.
+    region * regions_ = nullptr;
+    std::uintptr_t next_ = 0;
+    std::size_t used_ = 0;
+};
+
+//
+// Container is the std container template the allocator is meant for, eg
+// std::map, and T its value_type.
+//
+template <template <typename...> class Container, typename T>
+class contiguous_stdcontainer_allocator
+{
+public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+
+    using propagate_on_container_copy_assignment = std::false_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    template <typename U>
+    struct rebind
+    {
+        using other = contiguous_stdcontainer_allocator <Container, U>;
+    };
+
+    //
+    // Room for no element until the first allocation.
+    //
+    contiguous_stdcontainer_allocator () :
+        contiguous_stdcontainer_allocator {0}
+    {
+    }
+
+    //
+    // Room for elements elements.
+    //
+    explicit contiguous_stdcontainer_allocator (size_type elements) :
+        arena_ {std::make_shared <arena> (reserve_for (elements))}
+    {
+    }
+
+    template <typename U>
+    contiguous_stdcontainer_allocator (
+        const contiguous_stdcontainer_allocator <Container, U> & other
+    ) noexcept : arena_ {other.arena_}
+    {
+    }
+
+    T * allocate (size_type n)
+    {
+        return static_cast <T *> (
+            arena_->allocate (n * sizeof (T), alignof (T))
+        );
+    }
+
+    void deallocate (T *, size_type) noexcept
+    {
+    }
+
+    //
+    // A copy constructed container gets an arena of its own.
+    //
+    contiguous_stdcontainer_allocator
+    select_on_container_copy_construction () const
+    {
+        return contiguous_stdcontainer_allocator {
+            std::make_shared <arena> (arena_->used ())
+        };
+    }
+
+    const arena & get_arena () const noexcept
+    {
+        return * arena_;
+    }
+
+    template <typename U>
+    bool operator == (
+        const contiguous_stdcontainer_allocator <Container, U> & other
+    ) const noexcept
+    {
+        return arena_ == other.arena_;
+    }
+
+    template <typename U>
+    bool operator != (
+        const contiguous_stdcontainer_allocator <Container, U> & other
+    ) const noexcept
+    {
+        return ! (* this == other);
+    }
+
+private:
+    explicit contiguous_stdcontainer_allocator (
+        std::shared_ptr <arena> && a
+    ) noexcept : arena_ {std::move (a)}
+    {
+    }
+
+    //
+    // An element plus the links of its node, and of its hash bucket for an
+    // unordered container.
+    //
+    static size_type reserve_for (size_type elements) noexcept
+    {
+        return elements * (sizeof (T) + 5 * sizeof (void *));
+    }
+
+    std::shared_ptr <arena> arena_;
+
+    template <template <typename...> class, typename>
+    friend class contiguous_stdcontainer_allocator;
+};
+
+}
@@ -0,0 +1,86 @@
+#include "contiguous_stdcontainer_allocator.h"
+
+#include <iostream>
+#include <map>
+#include <string>
+#include <unordered_map>
+#include <utility>
+
+using utils::contiguous_stdcontainer_allocator;
+using std::cout;
+
+void ok(bool cond, const std::string & what)
+{
+    cout << (cond ? "\nOK : " : "\nFAIL : ") << what;
+}
+
+using ord_allocator = contiguous_stdcontainer_allocator<
+    std::map, std::pair<const int, int>
+>;
+using ord_map = std::map<int, int, std::less<int>, ord_allocator>;
+
+using unord_allocator = contiguous_stdcontainer_allocator<
+    std::unordered_map, std::pair<const int, int>
+>;
+using unord_map = std::unordered_map<
+    int, int, std::hash<int>, std::equal_to<int>, unord_allocator
+>;
+
+//
+// Every element is in one region when the expected size is right.
+//
+template<class Map>
+void test_contiguous(const std::string & name)
+{
+    Map m{typename Map::allocator_type{1000}};
+    for (int i = 0; i < 1000; ++i)
+    {
+        m[i] = i;
+    }
+
+    const auto & a = m.get_allocator().get_arena();
+    bool owned = true;
+    for (const auto & item : m)
+    {
+        owned = owned && a.owns(&item);
+    }
+    ok(owned && a.regions() == 1, name + " contiguous");
+}
+
+//
+// An arena grows past its expected size, and a copy gets its own arena.
+//
+void test_growth_and_copy()
+{
+    ord_map m{ord_allocator{10}};
+    for (int i = 0; i < 1000; ++i)
+    {
+        m[i] = i;
+    }
+    const auto & a = m.get_allocator().get_arena();
+    ok(m.size() == 1000 && a.regions() > 1, "arena grows");
+
+    ord_map copy{m};
+    const auto & b = copy.get_allocator().get_arena();
+    ok(&a != &b, "copy has its own arena");
+    ok(b.regions() == 1 && b.owns(&*copy.begin()), "copy is contiguous");
+
+    bool same = copy.size() == m.size();
+    for (int i = 0; same && i < 1000; ++i)
+    {
+        same = copy.at(i) == i;
+    }
+    ok(same, "copy contents");
+
+    ord_map sized{m, ord_allocator{m.size()}};
+    ok(sized.get_allocator().get_arena().regions() == 1, "sized copy");
+}
+
+int main(int, char **)
+{
+    test_contiguous<ord_map>("map");
+    test_contiguous<unord_map>("unordered_map");
+    test_growth_and_copy();
+    cout << "\ndone\n";
+    return 0;
+}